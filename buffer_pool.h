@@ -0,0 +1,152 @@
+/*!
+  \file        buffer_pool.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A pool of large image buffers, reused from one scan to the next
+instead of being allocated and page-faulted again for each scan.
+A buffer goes back to the pool when the last image sharing its pixels
+is released, as for any cv::Mat: the images can be handed over
+to other threads, for instance to the PostcardWriter.
+The largest buffer, sized to the largest scan decoded so far, is always kept.
+The other buffers are kept within a given number of bytes,
+the images that do not fit are allocated as usual.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class BufferPool {
+public:
+  //! the number of buffers the pool keeps, the others are freed when released
+  static const unsigned int MAX_BUFFERS = 8;
+  //! the default cap of the bytes kept by the pool, besides its largest buffer
+  static const size_t DEFAULT_MAX_BYTES = 256 * 1024 * 1024;
+
+  BufferPool(size_t max_bytes = DEFAULT_MAX_BYTES) : _max_bytes(max_bytes) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Get an 8-bit image backed by a free buffer of the pool.
+   * The smallest free buffer large enough is used. If there is none,
+   * a free buffer is enlarged, or a new one is allocated:
+   * the buffers grow to the largest image seen. The largest buffer
+   * is always kept, the others within the cap of the pool.
+   * \return a continuous image, whose pixels are not initialized
+   */
+  cv::Mat acquire(int rows, int cols, int channels) {
+    size_t bytes = (size_t) rows * cols * channels;
+    if (bytes == 0)
+      return cv::Mat(rows, cols, CV_8UC(channels));
+    std::lock_guard<std::mutex> lock(_mutex);
+    int best = -1, largest_free = -1;
+    for (unsigned int i = 0; i < _buffers.size(); ++i) {
+      if (!is_free(_buffers[i]))
+        continue;
+      if (largest_free < 0 || _buffers[i].cols > _buffers[largest_free].cols)
+        largest_free = i;
+      if ((size_t) _buffers[i].cols >= bytes
+          && (best < 0 || _buffers[i].cols < _buffers[best].cols))
+        best = i;
+    }
+    if (best < 0) { // enlarge the largest free buffer, or add one
+      size_t kept_bytes = bytes, largest_bytes = bytes;
+      for (unsigned int i = 0; i < _buffers.size(); ++i) {
+        if ((int) i == largest_free)
+          continue;
+        kept_bytes += _buffers[i].cols;
+        largest_bytes = std::max(largest_bytes, (size_t) _buffers[i].cols);
+      }
+      if ((largest_free < 0 && _buffers.size() >= MAX_BUFFERS)
+          || kept_bytes - largest_bytes > _max_bytes) {
+        ++allocation_counter(); // not kept by the pool
+        return cv::Mat(rows, cols, CV_8UC(channels));
+      }
+      best = (largest_free >= 0 ? largest_free : (int) _buffers.size());
+      if (best == (int) _buffers.size())
+        _buffers.push_back(cv::Mat());
+      _buffers[best].release();
+      _buffers[best].create(1, bytes, CV_8U);
+      ++allocation_counter();
+    }
+    // a view sharing the reference count of the buffer
+    return _buffers[best].colRange(0, bytes).reshape(channels, rows);
+  } // end acquire()
+
+  //! acquire() for color images
+  inline cv::Mat3b acquire3b(int rows, int cols) {
+    return cv::Mat3b(acquire(rows, cols, 3));
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the bytes kept by the pool
+  inline size_t capacity() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return bytes_kept();
+  }
+
+  /*!
+   * The number of buffers allocated by all the pools since the start.
+   * It stays constant once the largest images have been seen.
+   */
+  static size_t allocations() { return allocation_counter(); }
+
+  /*!
+   * Count a large allocation made outside of the pools,
+   * for instance by a decoder that could not write in the given buffer.
+   */
+  static void count_allocation() { ++allocation_counter(); }
+
+protected:
+  static std::atomic<size_t> & allocation_counter() {
+    static std::atomic<size_t> counter(0);
+    return counter;
+  }
+
+  //! the sum of the sizes of the buffers. Locked.
+  inline size_t bytes_kept() const {
+    size_t ans = 0;
+    for (unsigned int i = 0; i < _buffers.size(); ++i)
+      ans += _buffers[i].cols;
+    return ans;
+  }
+
+  //! \return true if only the pool refers to \a buffer
+  static bool is_free(const cv::Mat & buffer) {
+#if CV_MAJOR_VERSION >= 3
+    return buffer.u == NULL || buffer.u->refcount == 1;
+#else // CV_MAJOR_VERSION >= 3
+    return buffer.refcount == NULL || *buffer.refcount == 1;
+#endif // CV_MAJOR_VERSION >= 3
+  }
+
+  size_t _max_bytes;
+  std::vector<cv::Mat> _buffers; // one row of bytes each
+  mutable std::mutex _mutex;
+}; // end class BufferPool
+
+#endif // BUFFER_POOL_H
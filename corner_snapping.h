@@ -0,0 +1,95 @@
+/*!
+  \file        corner_snapping.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+
+The snapping of a clicked point to the nearest corner of a postcard.
+It only looks at the zoom window, that is already resampled around the cursor
+from the closest level of the pyramid: its cost does not depend on the scan.
+The corners are found with the minimum eigenvalue detector (Shi-Tomasi),
+then refined to sub-pixel precision with cv::cornerSubPix().
+ */
+
+#ifndef CORNER_SNAPPING_H
+#define CORNER_SNAPPING_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+
+class CornerSnapper {
+public:
+  //! the corners farther than this from the center are ignored, in pixels of the zoom
+  static const int SEARCH_RADIUS = 40;
+  //! below this standard deviation of the gray levels, the area is considered uniform
+  static constexpr double MIN_CONTRAST = 8;
+  static const int MAX_CANDIDATES = 16;
+  static constexpr double MIN_QUALITY = .1; //!< relative to the strongest corner
+  static const int MIN_DISTANCE = 4, BLOCK_SIZE = 5, SUBPIX_WINDOW = 4;
+
+  /*!
+   * Find the corner closest to the center of the zoom.
+   * \param zoom_img
+   *    the zoom window, centered on the cursor
+   * \param corner
+   *    the corner, in pixels of \a zoom_img
+   * \return true if a corner was found within SEARCH_RADIUS of the center
+   */
+  inline bool snap(const cv::Mat3b & zoom_img, cv::Point2f & corner) {
+    // the search area, with a margin for the sub-pixel refinement
+    int half_side = SEARCH_RADIUS + SUBPIX_WINDOW + BLOCK_SIZE;
+    cv::Point center(zoom_img.cols / 2, zoom_img.rows / 2);
+    cv::Rect roi = cv::Rect(center.x - half_side, center.y - half_side,
+                            2 * half_side + 1, 2 * half_side + 1)
+        & cv::Rect(0, 0, zoom_img.cols, zoom_img.rows);
+    if (roi.area() == 0)
+      return false;
+    cv::cvtColor(zoom_img(roi), _gray, cv::COLOR_BGR2GRAY);
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(_gray, mean, stddev);
+    if (stddev[0] < MIN_CONTRAST) // background or inside of a postcard
+      return false;
+    cv::goodFeaturesToTrack(_gray, _candidates, MAX_CANDIDATES, MIN_QUALITY,
+                            MIN_DISTANCE, cv::Mat(), BLOCK_SIZE);
+    cv::Point2f roi_center(center.x - roi.x, center.y - roi.y);
+    int best = -1;
+    float best_dist2 = SEARCH_RADIUS * SEARCH_RADIUS;
+    for (unsigned int i = 0; i < _candidates.size(); ++i) {
+      cv::Point2f diff = _candidates[i] - roi_center;
+      float dist2 = diff.dot(diff);
+      if (dist2 <= best_dist2) {
+        best = i;
+        best_dist2 = dist2;
+      }
+    } // end for i
+    if (best < 0)
+      return false;
+    std::vector<cv::Point2f> refined(1, _candidates[best]);
+    cv::cornerSubPix(_gray, refined, cv::Size(SUBPIX_WINDOW, SUBPIX_WINDOW), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 20, .01));
+    corner = refined.front() + cv::Point2f(roi.x, roi.y);
+    return true;
+  } // end snap()
+
+protected:
+  cv::Mat1b _gray; // kept between calls, the zoom always has the same size
+  std::vector<cv::Point2f> _candidates;
+}; // end class CornerSnapper
+
+#endif // CORNER_SNAPPING_H
@@ -0,0 +1,224 @@
+/*!
+  \file        encoder_profile.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The output format of the postcards and the parameters of its encoder,
+trading encoding time against file size.
+A profile is written as "format[:option]...", for instance:
+  png          PNG with the default compression of OpenCV
+  png:1        PNG with the zlib compression level 1 (0: none, 9: smallest)
+  jpeg:92      JPEG with the quality 92 (0 to 100)
+  jpeg:92:optimize  the same, with optimized Huffman tables
+  webp:90      lossy WebP with the quality 90 (1 to 100)
+  webp:lossless
+  tiff         lossless TIFF
+ */
+
+#ifndef ENCODER_PROFILE_H
+#define ENCODER_PROFILE_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// cv::IMWRITE_JPEG_OPTIMIZE appeared in OpenCV 3.1
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 1)
+#define ENCODER_PROFILE_JPEG_OPTIMIZE
+#endif
+
+class EncoderProfile {
+public:
+  //! PNG with the default parameters of OpenCV
+  EncoderProfile() : _name("png"), _extension(".png") {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Read a profile, cf the syntax at the top of this file.
+   * \return false if the profile is not valid, it is then left unchanged
+   */
+  bool parse(const std::string & name) {
+    std::vector<std::string> words;
+    std::istringstream in(name);
+    std::string word;
+    while (std::getline(in, word, ':'))
+      words.push_back(word);
+    if (words.empty()) {
+      printf("Empty encoder profile!\n");
+      return false;
+    }
+    std::string extension;
+    std::vector<int> params;
+    const std::string & format = words[0];
+    bool ok = true;
+    if (format == "png") {
+      extension = ".png";
+      if (words.size() >= 2) {
+        int level = 0;
+        ok = (words.size() == 2 && parse_int(words[1], 0, 9, level));
+        params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+        params.push_back(level);
+      }
+    }
+    else if (format == "jpeg" || format == "jpg") {
+      extension = ".jpg";
+      for (unsigned int i = 1; i < words.size() && ok; ++i) {
+        if (words[i] == "optimize") {
+#ifdef ENCODER_PROFILE_JPEG_OPTIMIZE
+          params.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
+          params.push_back(1);
+#else // ENCODER_PROFILE_JPEG_OPTIMIZE
+          printf("The JPEG optimization needs OpenCV 3.1, it is ignored.\n");
+#endif // ENCODER_PROFILE_JPEG_OPTIMIZE
+          continue;
+        }
+        int quality = 0;
+        ok = parse_int(words[i], 0, 100, quality);
+        params.push_back(cv::IMWRITE_JPEG_QUALITY);
+        params.push_back(quality);
+      } // end for i
+    }
+    else if (format == "webp") {
+      extension = ".webp";
+      if (words.size() >= 2) {
+        int quality = 101; // above 100, the encoder is lossless
+        ok = (words.size() == 2 && (words[1] == "lossless"
+                                    || parse_int(words[1], 1, 100, quality)));
+        params.push_back(cv::IMWRITE_WEBP_QUALITY);
+        params.push_back(quality);
+      }
+    }
+    else if (format == "tiff" || format == "tif") {
+      extension = ".tiff"; // always lossless
+      ok = (words.size() == 1);
+    }
+    else
+      ok = false;
+    if (!ok) {
+      printf("Invalid encoder profile '%s'!\n", name.c_str());
+      return false;
+    }
+    _name = name;
+    _extension = extension;
+    _params = params;
+    return true;
+  } // end parse()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline const std::string & name() const { return _name; }
+  //! the extension of the files, with its dot, for instance ".png"
+  inline const std::string & extension() const { return _extension; }
+  //! the parameters given to cv::imwrite()
+  inline const std::vector<int> & params() const { return _params; }
+
+  //! write an image, \a filename having the extension of the profile
+  inline bool write(const std::string & filename, const cv::Mat & img) const {
+    try {
+      return cv::imwrite(filename, img, _params);
+    } catch (cv::Exception & e) { // no encoder for this format
+      printf("Could not write '%s': %s\n", filename.c_str(), e.what());
+      return false;
+    }
+  }
+
+  //! encode an image in memory, in the format of the profile
+  inline bool encode(const cv::Mat & img, std::vector<uchar> & buffer) const {
+    try {
+      return cv::imencode(_extension, img, buffer, _params);
+    } catch (cv::Exception & e) { // no encoder for this format
+      printf("Could not encode in '%s': %s\n", _name.c_str(), e.what());
+      return false;
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the profiles compared by measure_encoder_profiles()
+  static std::vector<EncoderProfile> builtin_profiles() {
+    static const char* NAMES[] = {
+      "png:0", "png:1", "png:3", "png:6", "png:9",
+      "jpeg:85", "jpeg:95", "jpeg:95:optimize",
+      "webp:90", "webp:lossless", "tiff" };
+    std::vector<EncoderProfile> ans;
+    for (unsigned int i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); ++i) {
+      EncoderProfile profile;
+      if (profile.parse(NAMES[i]))
+        ans.push_back(profile);
+    }
+    return ans;
+  }
+
+protected:
+  //! \return true if \a word is an integer between \a min and \a max
+  static bool parse_int(const std::string & word, int min, int max, int & value) {
+    if (word.empty() || word.find_first_not_of("0123456789") != std::string::npos)
+      return false;
+    value = atoi(word.c_str());
+    return (value >= min && value <= max);
+  }
+
+  std::string _name, _extension;
+  std::vector<int> _params;
+}; // end class EncoderProfile
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Time the encoding of a sample postcard with each profile
+ * and print its speed and size.
+ * \param iterations
+ *    the number of encodings per profile, the median is printed
+ */
+inline void measure_encoder_profiles(const cv::Mat3b & sample,
+                                     const std::vector<EncoderProfile> & profiles,
+                                     unsigned int iterations = 5) {
+  double mpix = 1E-6 * sample.cols * sample.rows;
+  double raw_kb = sample.total() * sample.elemSize() / 1024.;
+  printf("Encoding a %ix%i postcard (%.0f kB raw), median of %i runs\n",
+         sample.cols, sample.rows, raw_kb, iterations);
+  printf("  %-18s %10s %10s %10s %8s\n", "profile", "time (ms)", "MPix/s",
+         "size (kB)", "ratio");
+  std::vector<uchar> buffer;
+  for (unsigned int i = 0; i < profiles.size(); ++i) {
+    std::vector<double> times_ms;
+    bool ok = true;
+    for (unsigned int j = 0; j < std::max(iterations, 1U) && ok; ++j) {
+      double t0 = cv::getTickCount();
+      ok = profiles[i].encode(sample, buffer);
+      times_ms.push_back((cv::getTickCount() - t0) * 1000. / cv::getTickFrequency());
+    }
+    if (!ok) {
+      printf("  %-18s unavailable\n", profiles[i].name().c_str());
+      continue;
+    }
+    std::sort(times_ms.begin(), times_ms.end());
+    double time_ms = times_ms[times_ms.size() / 2];
+    double kb = buffer.size() / 1024.;
+    printf("  %-18s %10.1f %10.1f %10.0f %7.1f%%\n", profiles[i].name().c_str(),
+           time_ms, 1000. * mpix / time_ms, kb, 100. * kb / raw_kb);
+  } // end for i
+} // end measure_encoder_profiles()
+
+#endif // ENCODER_PROFILE_H
@@ -0,0 +1,203 @@
+/*!
+  \file        hot_folder_watcher.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A folder watched with inotify, for a scanner dropping new scans
+while the postcards of the previous ones are being extracted.
+A scan is reported once it is complete, i.e. when the program writing it
+closes it, or when it is moved into the folder.
+inotify only exists on Linux: elsewhere, watch() fails and nothing is reported.
+ */
+
+#ifndef HOT_FOLDER_WATCHER_H
+#define HOT_FOLDER_WATCHER_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+class HotFolderWatcher {
+public:
+  HotFolderWatcher() : _fd(-1), _wd(-1) {}
+  ~HotFolderWatcher() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Start watching a folder.
+   * \param dir
+   *    the folder, not watched recursively
+   * \param ignored_pattern
+   *    the files whose name contains it are never reported,
+   *    for instance the postcards written next to the scans
+   * \param existing_scans
+   *    the scans already in the folder, sorted by name
+   * \return true if success
+   */
+  bool watch(const std::string & dir, const std::string & ignored_pattern,
+             std::vector<std::string> & existing_scans) {
+    stop();
+#ifndef __linux__
+    (void) ignored_pattern;
+    printf("Could not watch the folder '%s': only supported on Linux\n", dir.c_str());
+    existing_scans.clear();
+    return false;
+#else
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0) {
+      printf("Could not initialize inotify: %s\n", strerror(errno));
+      return false;
+    }
+    _wd = inotify_add_watch(_fd, dir.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (_wd < 0) {
+      printf("Could not watch the folder '%s': %s\n", dir.c_str(), strerror(errno));
+      stop();
+      return false;
+    }
+    // the scans are reported with canonical paths, cf canonical_path()
+    _dir = canonical_path(dir);
+    _ignored_pattern = ignored_pattern;
+    // listed after adding the watch, so that no scan is missed in between
+    existing_scans.clear();
+    return list_scans(existing_scans);
+#endif // __linux__
+  } // end watch()
+
+  inline bool is_watching() const { return _fd >= 0; }
+  inline const std::string & dir() const { return _dir; }
+
+  //! stop watching, the folder is left untouched
+  inline void stop() {
+    if (_fd >= 0)
+      close(_fd); // also removes the watch
+    _fd = _wd = -1;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Get the scans completed since the previous call, never wait.
+   * If the events overflowed, all the scans of the folder are reported:
+   * the caller must skip the scans it already knows.
+   * \param new_scans
+   *    the full paths of the new scans, by order of arrival
+   * \return true if there is at least a new scan
+   */
+  bool poll(std::vector<std::string> & new_scans) {
+    new_scans.clear();
+    if (_fd < 0)
+      return false;
+#ifdef __linux__
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+      ssize_t n = read(_fd, buffer, sizeof(buffer));
+      if (n <= 0) // EAGAIN: no more events
+        break;
+      for (char* ptr = buffer; ptr < buffer + n; ) {
+        const struct inotify_event* event = (const struct inotify_event*) ptr;
+        ptr += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          printf("Too many new files in '%s', listing it again.\n", _dir.c_str());
+          list_scans(new_scans);
+        }
+        else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+          printf("The folder '%s' was removed, it is not watched anymore.\n",
+                 _dir.c_str());
+          stop();
+          return !new_scans.empty();
+        }
+        else if (event->len > 0 && is_scan_filename(event->name, _ignored_pattern))
+          new_scans.push_back(_dir + "/" + event->name);
+      } // end loop ptr
+    } // end while (true)
+#endif // __linux__
+    return !new_scans.empty();
+  } // end poll()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \return the absolute path of \a path, without symbolic links,
+   *    "." nor "..", so that two spellings of a scan can be compared.
+   *    \a path itself if it does not exist.
+   */
+  static std::string canonical_path(const std::string & path) {
+    char* resolved = realpath(path.c_str(), NULL);
+    if (!resolved)
+      return path;
+    std::string ans(resolved);
+    free(resolved);
+    return ans;
+  } // end canonical_path()
+
+  //! \return true if \a name has the extension of an image and is not ignored
+  static bool is_scan_filename(const std::string & name,
+                               const std::string & ignored_pattern) {
+    if (name.empty() || name[0] == '.') // hidden or temporary files
+      return false;
+    if (!ignored_pattern.empty() && name.find(ignored_pattern) != std::string::npos)
+      return false;
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos)
+      return false;
+    static const char* EXTENSIONS[] = { "jpg", "jpeg", "jpe", "png", "bmp", "tif",
+                                        "tiff", "webp", "jp2", "pbm", "pgm", "ppm" };
+    for (unsigned int i = 0; i < sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]); ++i)
+      if (strcasecmp(name.c_str() + dot + 1, EXTENSIONS[i]) == 0)
+        return true;
+    return false;
+  } // end is_scan_filename()
+
+protected:
+  //! append the scans of the folder, sorted by name
+  bool list_scans(std::vector<std::string> & scans) const {
+    DIR* d = opendir(_dir.c_str());
+    if (!d) {
+      printf("Could not open the folder '%s'!\n", _dir.c_str());
+      return false;
+    }
+    std::vector<std::string> names;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL)
+      if (is_scan_filename(entry->d_name, _ignored_pattern))
+        names.push_back(entry->d_name);
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    for (unsigned int i = 0; i < names.size(); ++i)
+      scans.push_back(_dir + "/" + names[i]);
+    return true;
+  } // end list_scans()
+
+  int _fd, _wd;
+  std::string _dir, _ignored_pattern;
+}; // end class HotFolderWatcher
+
+#endif // HOT_FOLDER_WATCHER_H
@@ -0,0 +1,203 @@
+/*!
+  \file        input_events.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The key and mouse events of a GUI session, with their time,
+recorded so that the session can be replayed without window
+to measure the latency of each frame, cf PostcardScanExtractor::replay_input_events().
+The log is a text file: the playlist of the session, one "file PATH" line per scan,
+then one line per event:
+  key TIME_MS KEY
+  mouse TIME_MS EVENT X Y FLAGS
+KEY being the value returned by cv::waitKey(), and EVENT, X, Y, FLAGS
+the parameters of the mouse callback.
+ */
+
+#ifndef INPUT_EVENTS_H
+#define INPUT_EVENTS_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct InputEvent {
+  enum Type { KEY = 0, MOUSE = 1 };
+
+  InputEvent() : time_ms(0), type(KEY), key(-1), mouse_event(0), x(0), y(0), flags(0) {}
+
+  static InputEvent key_event(double time_ms, int key) {
+    InputEvent ans;
+    ans.time_ms = time_ms;
+    ans.key = key;
+    return ans;
+  }
+
+  static InputEvent mouse(double time_ms, int mouse_event, int x, int y, int flags) {
+    InputEvent ans;
+    ans.time_ms = time_ms;
+    ans.type = MOUSE;
+    ans.mouse_event = mouse_event;
+    ans.x = x;
+    ans.y = y;
+    ans.flags = flags;
+    return ans;
+  }
+
+  //! the clock of the events, in milliseconds
+  static double now_ms() {
+    return cv::getTickCount() * 1000. / cv::getTickFrequency();
+  }
+
+  //! \return the kind of event, for grouping the latencies, for instance "key 'n'"
+  std::string category() const {
+    std::ostringstream ans;
+    if (type == MOUSE) {
+      if (mouse_event == CV_EVENT_MOUSEMOVE)
+        ans << "mouse move";
+      else if (mouse_event == CV_EVENT_LBUTTONDOWN)
+        ans << "left click";
+      else if (mouse_event == CV_EVENT_RBUTTONDOWN)
+        ans << "right click";
+      else
+        ans << "mouse event " << mouse_event;
+    }
+    else {
+      char c = key; // as in PostcardScanExtractor::handle_key()
+      if (c > 32 && c < 127)
+        ans << "key '" << c << "'";
+      else
+        ans << "key " << (int) c;
+    }
+    return ans.str();
+  }
+
+  double time_ms; //!< since the start of the recording
+  Type type;
+  int key;
+  int mouse_event, x, y, flags;
+}; // end struct InputEvent
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! \return true if success
+inline bool save_input_events(const std::string & filename,
+                              const std::vector<std::string> & playlist,
+                              const std::vector<InputEvent> & events) {
+  std::ofstream out(filename.c_str());
+  if (!out) {
+    printf("Could not write '%s'!\n", filename.c_str());
+    return false;
+  }
+  out << std::fixed << std::setprecision(3); // long sessions, in ms
+  for (unsigned int i = 0; i < playlist.size(); ++i)
+    out << "file " << playlist[i] << std::endl;
+  for (unsigned int i = 0; i < events.size(); ++i) {
+    const InputEvent & e = events[i];
+    if (e.type == InputEvent::KEY)
+      out << "key " << e.time_ms << " " << e.key << std::endl;
+    else
+      out << "mouse " << e.time_ms << " " << e.mouse_event << " "
+          << e.x << " " << e.y << " " << e.flags << std::endl;
+  }
+  printf("Written %i events in '%s'\n", (int) events.size(), filename.c_str());
+  return out.good();
+} // end save_input_events()
+
+//! \return true if success
+inline bool load_input_events(const std::string & filename,
+                              std::vector<std::string> & playlist,
+                              std::vector<InputEvent> & events) {
+  playlist.clear();
+  events.clear();
+  std::ifstream in(filename.c_str());
+  if (!in) {
+    printf("Could not read '%s'!\n", filename.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 5, "file ") == 0) {
+      playlist.push_back(line.substr(5));
+      continue;
+    }
+    std::istringstream words(line);
+    std::string type;
+    InputEvent e;
+    bool ok = !(words >> type >> e.time_ms).fail();
+    if (ok && type == "key")
+      ok = !(words >> e.key).fail();
+    else if (ok && type == "mouse") {
+      e.type = InputEvent::MOUSE;
+      ok = !(words >> e.mouse_event >> e.x >> e.y >> e.flags).fail();
+    }
+    else
+      ok = false;
+    if (!ok) {
+      printf("Invalid line '%s' in '%s'!\n", line.c_str(), filename.c_str());
+      return false;
+    }
+    events.push_back(e);
+  } // end while (getline)
+  return true;
+} // end load_input_events()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Print the percentiles of the frame latencies of each category of events.
+ * \param latencies_ms
+ *    the latency of each event, cf PostcardScanExtractor::replay_input_events()
+ * \param csv_filename
+ *    if not empty, where the latency of each event is written
+ */
+inline void print_frame_latencies(const std::vector<InputEvent> & events,
+                                  const std::vector<double> & latencies_ms,
+                                  const std::string & csv_filename = "") {
+  std::map<std::string, std::vector<double> > categories;
+  for (unsigned int i = 0; i < latencies_ms.size() && i < events.size(); ++i)
+    categories[events[i].category()].push_back(latencies_ms[i]);
+  printf("Frame latency, from the event to the end of the rendering\n");
+  for (std::map<std::string, std::vector<double> >::iterator it = categories.begin();
+       it != categories.end(); ++it) {
+    std::vector<double> & samples = it->second;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    printf("  %-28s n=%4i  p50:%9.2f  p90:%9.2f  p99:%9.2f  max:%9.2f ms\n",
+           it->first.c_str(), (int) n, samples[std::min(n - 1, (size_t) (.5 * n))],
+           samples[std::min(n - 1, (size_t) (.9 * n))],
+           samples[std::min(n - 1, (size_t) (.99 * n))], samples.back());
+  }
+  if (csv_filename.empty())
+    return;
+  std::ofstream csv(csv_filename.c_str());
+  csv << "time_ms,event,latency_ms" << std::endl;
+  for (unsigned int i = 0; i < latencies_ms.size() && i < events.size(); ++i)
+    csv << events[i].time_ms << ",\"" << events[i].category() << "\","
+        << latencies_ms[i] << std::endl;
+  printf("Written the latency of each event in '%s'\n", csv_filename.c_str());
+} // end print_frame_latencies()
+
+#endif // INPUT_EVENTS_H
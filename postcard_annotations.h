@@ -0,0 +1,148 @@
+/*!
+  \file        tiled_image.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The corners and orientations of the postcards of a scan, saved in a small
+text file next to it, so that the postcards can be extracted again later,
+for instance in another format, without clicking them again.
+
+The sidecar of "/foo/scan.jpg" is "/foo/scan.postcards":
+  # index x0 y0 x1 y1 x2 y2 rotation mirrored
+  0 120.5 88 1630 92.25 1626.75 1150 1 0
+The corners are in the pixels of the scan file, as decoded,
+before any rotation to landscape.
+ */
+
+#ifndef POSTCARD_ANNOTATIONS_H
+#define POSTCARD_ANNOTATIONS_H
+
+#include <opencv2/core/core.hpp>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "postcard_extraction.h"
+#include "postcard_orientation.h"
+
+struct PostcardAnnotation {
+  PostcardAnnotation() : idx(0) {}
+  //! the index of the postcard in its filename, cf postcard_filename()
+  unsigned int idx;
+  //! top-left, top-right and bottom-right corners, cf extract_postcard()
+  cv::Point2f corners[3];
+  PostcardOrientation orientation;
+}; // end struct PostcardAnnotation
+
+//! \example "/foo/scan.jpg" -> "/foo/scan.postcards"
+inline std::string annotations_filename(const std::string & scan_filename) {
+  return remove_filename_extension(scan_filename) + ".postcards";
+}
+
+//! \return true if \a filename exists and can be read
+inline bool file_readable(const std::string & filename) {
+  FILE* f = fopen(filename.c_str(), "r");
+  if (f == NULL)
+    return false;
+  fclose(f);
+  return true;
+}
+
+//! replace the annotation with the same index as \a annotation, or append it
+inline void set_annotation(std::vector<PostcardAnnotation> & annotations,
+                           const PostcardAnnotation & annotation) {
+  for (unsigned int i = 0; i < annotations.size(); ++i) {
+    if (annotations[i].idx == annotation.idx) {
+      annotations[i] = annotation;
+      return;
+    }
+  }
+  annotations.push_back(annotation);
+}
+
+//! \return true if the scan has a sidecar
+inline bool has_annotations(const std::string & scan_filename) {
+  return file_readable(annotations_filename(scan_filename));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Write the sidecar of a scan, replacing the previous one.
+ * \return true if success
+ */
+inline bool save_annotations(const std::string & scan_filename,
+                             const std::vector<PostcardAnnotation> & annotations) {
+  std::string filename = annotations_filename(scan_filename);
+  FILE* f = fopen(filename.c_str(), "w");
+  if (f == NULL) {
+    printf("Could not write '%s'!\n", filename.c_str());
+    return false;
+  }
+  fprintf(f, "# index x0 y0 x1 y1 x2 y2 rotation mirrored\n");
+  for (unsigned int i = 0; i < annotations.size(); ++i) {
+    const PostcardAnnotation & a = annotations[i];
+    fprintf(f, "%u", a.idx);
+    for (unsigned int j = 0; j < 3; ++j)
+      fprintf(f, " %.9g %.9g", a.corners[j].x, a.corners[j].y);
+    fprintf(f, " %u %i\n", a.orientation.rotation(), (int) a.orientation.mirrored());
+  }
+  bool ok = (fclose(f) == 0);
+  if (!ok)
+    printf("Could not write '%s'!\n", filename.c_str());
+  return ok;
+} // end save_annotations()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Read the sidecar of a scan.
+ * \return true if success. A missing sidecar is a failure.
+ */
+inline bool load_annotations(const std::string & scan_filename,
+                             std::vector<PostcardAnnotation> & annotations) {
+  annotations.clear();
+  std::string filename = annotations_filename(scan_filename);
+  FILE* f = fopen(filename.c_str(), "r");
+  if (f == NULL) {
+    printf("Could not read '%s'!\n", filename.c_str());
+    return false;
+  }
+  char line[512];
+  bool ok = true;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    PostcardAnnotation a;
+    unsigned int rotation;
+    int mirrored;
+    if (sscanf(line, "%u %f %f %f %f %f %f %u %i", &a.idx,
+               &a.corners[0].x, &a.corners[0].y, &a.corners[1].x, &a.corners[1].y,
+               &a.corners[2].x, &a.corners[2].y, &rotation, &mirrored) != 9) {
+      printf("Could not parse '%s': '%s'\n", filename.c_str(), line);
+      ok = false;
+      continue;
+    }
+    a.orientation = PostcardOrientation(rotation, mirrored != 0);
+    annotations.push_back(a);
+  } // end while (fgets)
+  fclose(f);
+  return ok;
+} // end load_annotations()
+
+#endif // POSTCARD_ANNOTATIONS_H
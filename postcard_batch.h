@@ -0,0 +1,199 @@
+/*!
+  \file        postcard_batch.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The headless batch mode: the postcards of each scan are detected
+automatically and extracted, the scans being spread across all cores.
+The replay mode extracts again the postcards saved in the sidecars.
+ */
+
+#ifndef POSTCARD_BATCH_H
+#define POSTCARD_BATCH_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <stdio.h>
+#include <exception>
+#include <mutex>
+#include "encoder_profile.h"
+#include "postcard_annotations.h"
+#include "postcard_core.h"
+#include "postcard_extraction.h"
+#include "postcard_variants.h"
+#include "stage_profiler.h"
+#include "work_stealing_pool.h"
+
+class PostcardBatch {
+public:
+  /*!
+   * \param replay
+   *    if false, detect the postcards and save their sidecars,
+   *    cf save_annotations(). If true, read the sidecars instead.
+   * \param encoder
+   *    the format of the postcards
+   * \param force
+   *    if false, the detection skips the scans that already have a sidecar
+   *    and does not overwrite existing postcards, that may have been
+   *    extracted by hand. Ignored in replay mode, which always overwrites.
+   */
+  PostcardBatch(const std::string & postcard_suffix = "_postcard",
+                unsigned int nthreads = 0, bool replay = false,
+                const EncoderProfile & encoder = EncoderProfile(),
+                bool force = false) :
+    _postcard_suffix(postcard_suffix), _nthreads(nthreads), _replay(replay),
+    _encoder(encoder), _force(force),
+    _core(0) {} // each scan is read once, only the ones being processed are kept
+
+  //! also write each postcard at a smaller size, cf PostcardVariant
+  inline void add_postcard_variant(const PostcardVariant & variant) {
+    _variants.push_back(variant);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Detect and extract the postcards of all scans.
+   * \return true if all scans could be processed
+   */
+  inline bool run(const std::vector<std::string> & filenames) {
+    _nfiles_ok = _nfailures = _npostcards = _nskipped = 0;
+    _total_mpix = 0;
+    double t0 = cv::getTickCount();
+    cv::setNumThreads(1); // the parallelism is across scans
+    {
+      WorkStealingPool pool(_nthreads);
+      printf("Processing %i scans on %i threads\n",
+             (int) filenames.size(), pool.nthreads());
+      for (unsigned int i = 0; i < filenames.size(); ++i)
+        pool.submit(std::bind(&PostcardBatch::process_file, this, filenames[i]));
+      pool.wait();
+    }
+    double time_s = (cv::getTickCount() - t0) / cv::getTickFrequency();
+    printf("Processed %i scans (%i failures, %i skipped), %i postcards in %.1f s: "
+           "%.2f scans/s, %.1f MPix/s\n",
+           _nfiles_ok, _nfailures, _nskipped, _npostcards, time_s,
+           _nfiles_ok / time_s, _total_mpix / time_s);
+    return (_nfailures == 0);
+  } // end run()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  //! process_scan(), a corrupt scan making OpenCV throw being counted as a failure
+  void process_file(const std::string & filename) {
+    try {
+      process_scan(filename);
+    } catch (const std::exception & e) {
+      printf("Could not process '%s': %s\n", filename.c_str(), e.what());
+      std::lock_guard<std::mutex> lock(_stats_mutex);
+      ++_nfailures;
+    }
+  }
+
+  void process_scan(const std::string & filename) {
+    double t0 = cv::getTickCount();
+    // the postcards of a sidecar may have been clicked by hand
+    if (!_replay && !_force && has_annotations(filename)) {
+      printf("'%s' already has a sidecar, skipped (use --replay, or --force to detect again)\n",
+             filename.c_str());
+      std::lock_guard<std::mutex> lock(_stats_mutex);
+      ++_nskipped;
+      return;
+    }
+    // in replay mode, skip the decoding if there is nothing to extract
+    std::vector<PostcardAnnotation> annotations;
+    cv::Mat3b scan;
+    if ((_replay && !load_annotations(filename, annotations))
+        || !_core.load_scan(filename, scan)) {
+      std::lock_guard<std::mutex> lock(_stats_mutex);
+      ++_nfailures;
+      return;
+    }
+    bool ok = true;
+    if (!_replay) {
+      std::vector< std::vector<cv::Point2f> > corners;
+      {
+        ScopedStageTimer timer(StageProfiler::DETECTION);
+        detect_postcards(scan, corners);
+      }
+      annotations.resize(corners.size());
+      for (unsigned int i = 0; i < corners.size(); ++i) {
+        annotations[i].idx = i;
+        std::copy(corners[i].begin(), corners[i].begin() + 3, annotations[i].corners);
+      }
+    }
+    unsigned int nwritten = 0;
+    for (unsigned int i = 0; i < annotations.size(); ++i) {
+      std::string out = postcard_filename(filename, _postcard_suffix, annotations[i].idx,
+                                          _encoder.extension());
+      if (!_replay && !_force && file_readable(out)) {
+        printf("'%s' already exists, not overwritten (use --force)\n", out.c_str());
+        ok = false;
+        continue;
+      }
+      cv::Mat3b postcard;
+      if (!PostcardCore::extract_from_scan(scan, annotations[i], postcard)) {
+        printf("Could not extract '%s'!\n", out.c_str());
+        ok = false;
+        continue;
+      }
+      if (!PostcardCore::write(out, postcard, _encoder)) {
+        ok = false;
+        continue;
+      }
+      for (unsigned int j = 0; j < _variants.size(); ++j) {
+        if (!PostcardCore::write(_variants[j].filename(out),
+                                 shrink_image(postcard, _variants[j].max_size),
+                                 _variants[j].encoder))
+          ok = false;
+      } // end for j
+      ++nwritten;
+    } // end for i
+    // without postcard, no sidecar: the next runs will detect again
+    if (!_replay && nwritten > 0 && !save_annotations(filename, annotations))
+      ok = false;
+    double time_ms = (cv::getTickCount() - t0) * 1000. / cv::getTickFrequency();
+    double mpix = 1E-6 * scan.cols * scan.rows;
+    printf("'%s': %i postcards, %.1f MPix in %.0f ms (%.1f MPix/s)\n",
+           filename.c_str(), (int) annotations.size(), mpix, time_ms,
+           1000. * mpix / time_ms);
+    std::lock_guard<std::mutex> lock(_stats_mutex);
+    if (ok)
+      ++_nfiles_ok;
+    else
+      ++_nfailures;
+    _npostcards += annotations.size();
+    _total_mpix += mpix;
+  } // end process_scan()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::string _postcard_suffix;
+  unsigned int _nthreads;
+  bool _replay;
+  EncoderProfile _encoder;
+  bool _force;
+  std::vector<PostcardVariant> _variants;
+  PostcardCore _core; // the decoding and the extraction
+  std::mutex _stats_mutex;
+  unsigned int _nfiles_ok, _nfailures, _npostcards, _nskipped;
+  double _total_mpix;
+}; // end class PostcardBatch
+
+#endif // POSTCARD_BATCH_H
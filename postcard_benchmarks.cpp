@@ -0,0 +1,440 @@
+/*!
+  \file        postcard_benchmarks.cpp
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+Benchmarks of the core operations of PostcardScanExtractor,
+on synthetic A4 scans at several resolutions and on the bundled samples.
+No window is created, so they can run without a display.
+
+Synopsis
+  postcard_benchmarks [--dpi N]... [--iterations N]
+  postcard_benchmarks --check
+The check compares the pixels of the extraction paths with the ones
+of cv::warpAffine() on random postcards, and fails if they differ.
+ */
+
+#include "postcard_scan_extractor.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <fstream>
+
+//! make the protected operations callable from the benchmarks
+class BenchmarkedExtractor : public PostcardScanExtractor {
+public:
+  BenchmarkedExtractor() : PostcardScanExtractor("_postcard", false) {}
+  using PostcardScanExtractor::set_image;
+  using PostcardScanExtractor::recompute_zoom_and_redraw;
+  using PostcardScanExtractor::add_corner;
+  using PostcardScanExtractor::save_current_postcard;
+  using PostcardScanExtractor::get_current_postcard_filename;
+  using PostcardScanExtractor::upgrade_to_full_resolution;
+  inline void set_cursor(double x, double y, double zoom_level) {
+    _last_mouse_x = x;
+    _last_mouse_y = y;
+    _zoom_level = zoom_level;
+  }
+  inline const TiledPyramid & pyramid() const { return _scan_pyramid; }
+  inline cv::Size lores_size() const { return _scan_img_lores.size(); }
+}; // end class BenchmarkedExtractor
+
+////////////////////////////////////////////////////////////////////////////////
+
+class LatencyStats {
+public:
+  LatencyStats(const std::string & name) : _name(name) {}
+  inline void add(double ms) { _samples.push_back(ms); }
+  //! print the latency percentiles, in milliseconds
+  void print() {
+    if (_samples.empty())
+      return;
+    std::sort(_samples.begin(), _samples.end());
+    printf("  %-28s n=%4i  p50:%9.2f  p90:%9.2f  p99:%9.2f  max:%9.2f ms\n",
+           _name.c_str(), (int) _samples.size(), percentile(.5),
+           percentile(.9), percentile(.99), _samples.back());
+  }
+protected:
+  inline double percentile(double p) const {
+    return _samples[std::min(_samples.size() - 1, (size_t) (p * _samples.size()))];
+  }
+  std::string _name;
+  std::vector<double> _samples;
+}; // end class LatencyStats
+
+inline double now_ms() {
+  return cv::getTickCount() * 1000. / cv::getTickFrequency();
+}
+
+//! print the current and peak resident memory
+void print_memory(const std::string & when) {
+  long pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%li %li", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("  memory %-20s RSS:%7.1f MB  peak RSS:%7.1f MB  large allocations:%i\n",
+         when.c_str(), resident * sysconf(_SC_PAGESIZE) / 1048576.,
+         usage.ru_maxrss / 1024., (int) BufferPool::allocations());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! a portrait A4 scan: a noisy light background with four rotated postcards
+void make_synthetic_scan(unsigned int dpi, cv::Mat3b & scan) {
+  int cols = 8.27 * dpi, rows = 11.69 * dpi;
+  scan.create(rows, cols);
+  cv::randu(scan, cv::Scalar::all(215), cv::Scalar::all(240));
+  for (unsigned int i = 0; i < 4; ++i) {
+    cv::RotatedRect rect(cv::Point2f(cols * (.27 + .46 * (i % 2)),
+                                     rows * (.27 + .46 * (i / 2))),
+                         cv::Size2f(5.8 * dpi * .6, 4.1 * dpi * .6), 3. * i - 4);
+    cv::Point2f pts[4];
+    rect.points(pts);
+    std::vector<cv::Point> poly;
+    for (unsigned int j = 0; j < 4; ++j)
+      poly.push_back(pts[j]);
+    cv::Scalar color(40 + 50 * i, 120, 200 - 40 * i);
+    cv::fillConvexPoly(scan, poly, color);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string make_temp_dir() {
+  const char* tmpdir = getenv("TMPDIR");
+  std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/postcard_benchmarks_XXXXXX";
+  std::vector<char> buffer(path.begin(), path.end());
+  buffer.push_back('\0');
+  if (mkdtemp(&(buffer[0])) == NULL)
+    return "";
+  return std::string(&(buffer[0]));
+}
+
+void remove_dir(const std::string & path) {
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+    return;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name(entry->d_name);
+    if (name != "." && name != "..")
+      unlink((path + "/" + name).c_str());
+  }
+  closedir(dir);
+  rmdir(path.c_str());
+}
+
+bool copy_file(const std::string & src, const std::string & dst) {
+  std::ifstream in(src.c_str(), std::ios::binary);
+  std::ofstream out(dst.c_str(), std::ios::binary);
+  if (!in || !out)
+    return false;
+  out << in.rdbuf();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * A smooth synthetic scan: the 1/32 pixel quantization of the bilinear weights
+ * changes the interpolated values of less than a gray level.
+ */
+void make_smooth_scan(int cols, int rows, cv::Mat3b & scan) {
+  scan.create(rows, cols);
+  for (int row = 0; row < rows; ++row)
+    for (int col = 0; col < cols; ++col)
+      scan(row, col) = cv::Vec3b(cv::saturate_cast<uchar>(128 + 60 * sin(col / 10.)),
+                                 cv::saturate_cast<uchar>(128 + 60 * cos(row / 10.)),
+                                 cv::saturate_cast<uchar>(128 + 60 * sin((row + col) / 14.)));
+}
+
+//! \return the maximum difference of the channels of two images, 256 if their sizes differ
+int max_difference(const cv::Mat3b & a, const cv::Mat3b & b) {
+  if (a.size() != b.size())
+    return 256;
+  if (a.empty())
+    return 0;
+  cv::Mat3b diff;
+  cv::absdiff(a, b, diff);
+  double max_value = 0;
+  cv::minMaxLoc(diff.reshape(1), NULL, &max_value);
+  return (int) max_value;
+}
+
+//! keep the maximum difference of a path and print the failing postcards
+class DifferenceStats {
+public:
+  DifferenceStats(const std::string & name) : _name(name), _max(0), _n(0), _nfailures(0) {}
+  inline void add(int difference, const cv::Point2f corners[3]) {
+    ++_n;
+    _max = std::max(_max, difference);
+    if (difference <= MAX_DIFFERENCE)
+      return;
+    ++_nfailures;
+    printf("  %s: difference %i for corners (%g,%g) (%g,%g) (%g,%g)\n", _name.c_str(),
+           difference, corners[0].x, corners[0].y, corners[1].x, corners[1].y,
+           corners[2].x, corners[2].y);
+  }
+  inline bool print() const {
+    printf("  %-34s n=%5i  max difference:%4i  %s\n", _name.c_str(), _n, _max,
+           (_nfailures == 0 ? "OK" : "FAILED"));
+    return (_nfailures == 0);
+  }
+  static const int MAX_DIFFERENCE = 1; //!< per channel
+protected:
+  std::string _name;
+  int _max, _n, _nfailures;
+}; // end class DifferenceStats
+
+/*!
+ * Compare extract_postcard() and extract_axis_aligned_postcard()
+ * with extract_postcard_opencv(), on rotated postcards partly outside the scan,
+ * and on axis-aligned ones in all their right-angle orientations,
+ * some touching the edges of the scan. The postcards axis-aligned within a pixel
+ * are compared with the warp of their snapped corners, cf snap_axis_aligned_corners().
+ * \return true if all differences are within DifferenceStats::MAX_DIFFERENCE
+ */
+bool check_extraction(unsigned int ncases) {
+  printf("\nChecking the extraction against cv::warpAffine() (%i scans)\n", ncases);
+  DifferenceStats rotated("rotated, extract_postcard"),
+      aligned("axis-aligned, extract_postcard"),
+      aligned_copy("axis-aligned, copy"),
+      near_aligned("axis-aligned within a pixel, copy");
+  cv::RNG rng(1);
+  cv::Mat3b scan, reference, postcard;
+  for (unsigned int i = 0; i < ncases; ++i) {
+    // odd and even sizes
+    int cols = rng.uniform(64, 401), rows = rng.uniform(64, 401);
+    make_smooth_scan(cols, rows, scan);
+    // rotated, the center possibly close to the borders
+    double angle = rng.uniform(-CV_PI, CV_PI), w = rng.uniform(2., cols * .8),
+        h = rng.uniform(2., rows * .8);
+    cv::Point2f center(rng.uniform(0.f, (float) cols), rng.uniform(0.f, (float) rows)),
+        u(w * cos(angle), w * sin(angle)), v(-h * sin(angle), h * cos(angle));
+    cv::Point2f corners[3] = { center - .5f * u - .5f * v, center + .5f * u - .5f * v,
+                               center + .5f * u + .5f * v };
+    cv::Point2f snapped_corners[3]; // the near-aligned ones are copied, checked below
+    if (!snap_axis_aligned_corners(corners, snapped_corners)
+        && extract_postcard_opencv(scan, corners, reference)) {
+      extract_postcard(scan, corners, postcard);
+      rotated.add(max_difference(reference, postcard), corners);
+    }
+    // axis-aligned, the first ones touching the top-left and bottom-right corners
+    int rect_w = rng.uniform(1, cols + 1), rect_h = rng.uniform(1, rows + 1);
+    int x0 = (i % 3 == 0 ? 0 : i % 3 == 1 ? cols - rect_w : rng.uniform(0, cols - rect_w + 1)),
+        y0 = (i % 3 == 0 ? 0 : i % 3 == 1 ? rows - rect_h : rng.uniform(0, rows - rect_h + 1));
+    cv::Point2f rect_corners[3] = { cv::Point2f(x0, y0), cv::Point2f(x0 + rect_w, y0),
+                                    cv::Point2f(x0 + rect_w, y0 + rect_h) };
+    for (unsigned int rotation = 0; rotation < 4; ++rotation) {
+      for (unsigned int mirrored = 0; mirrored < 2; ++mirrored) {
+        cv::Point2f oriented_corners[3];
+        PostcardOrientation(rotation, mirrored).orient_corners(rect_corners, oriented_corners);
+        if (!extract_postcard_opencv(scan, oriented_corners, reference))
+          continue;
+        extract_postcard(scan, oriented_corners, postcard);
+        aligned.add(max_difference(reference, postcard), oriented_corners);
+        // the copy refuses the postcards that go out of the scan
+        if (extract_axis_aligned_postcard(scan, oriented_corners, postcard))
+          aligned_copy.add(max_difference(reference, postcard), oriented_corners);
+        // the same, with corners clicked a fraction of pixel away
+        cv::Point2f near_corners[3];
+        for (unsigned int k = 0; k < 3; ++k)
+          near_corners[k] = oriented_corners[k]
+              + cv::Point2f(rng.uniform(-.45f, .45f), rng.uniform(-.45f, .45f));
+        if (snap_axis_aligned_corners(near_corners, snapped_corners)
+            && extract_postcard_opencv(scan, snapped_corners, reference)
+            && extract_axis_aligned_postcard(scan, near_corners, postcard))
+          near_aligned.add(max_difference(reference, postcard), near_corners);
+      } // end for mirrored
+    } // end for rotation
+  } // end for i
+  bool ok = rotated.print();
+  ok = aligned.print() && ok;
+  ok = aligned_copy.print() && ok;
+  ok = near_aligned.print() && ok;
+  return ok;
+} // end check_extraction()
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! benchmark all operations on a set of scans
+void benchmark_scans(const std::string & title,
+                     const std::vector<std::string> & filenames,
+                     unsigned int iterations) {
+  printf("\n%s (%i scans)\n", title.c_str(), (int) filenames.size());
+  LatencyStats decode("decode (cv::imread)"), set_image("set_image"),
+      zoom("recompute_zoom_and_redraw"), corner("add_corner (3 clicks)"),
+      warp("extraction warp"), encode("PNG encode"),
+      opencv_warp("  rotated, cv::warpAffine"),
+      aligned_warp("  axis-aligned, copy"),
+      save("save_current_postcard"), switch_image("playlist switch"),
+      full_resolution("  then full resolution");
+  BenchmarkedExtractor extractor;
+  extractor.load_playlist_images(filenames);
+  cv::RNG rng(0);
+  for (unsigned int file_idx = 0; file_idx < filenames.size(); ++file_idx) {
+    double t0 = now_ms();
+    cv::Mat3b scan = cv::imread(filenames[file_idx], CV_LOAD_IMAGE_COLOR);
+    decode.add(now_ms() - t0);
+    printf("  '%s': %ix%i\n", filenames[file_idx].c_str(), scan.cols, scan.rows);
+    for (unsigned int i = 0; i < iterations; ++i) {
+      t0 = now_ms();
+      extractor.set_image(scan);
+      set_image.add(now_ms() - t0);
+    }
+    scan.release();
+    // zoom at random positions and levels
+    cv::Size lores = extractor.lores_size();
+    for (unsigned int i = 0; i < 50 * iterations; ++i) {
+      extractor.set_cursor(rng.uniform(0, lores.width + 2 * PostcardScanExtractor::MARGIN_SIZE),
+                           rng.uniform(0, lores.height + 2 * PostcardScanExtractor::MARGIN_SIZE),
+                           rng.uniform(1., 100.));
+      t0 = now_ms();
+      extractor.recompute_zoom_and_redraw();
+      zoom.add(now_ms() - t0);
+    }
+    // a slightly rotated postcard covering a quarter of the scan
+    const TiledImage & hires = *extractor.pyramid().front();
+    int m = PostcardScanExtractor::MARGIN_SIZE;
+    cv::Point gui_corners[3] = { cv::Point(m + lores.width / 10, m + lores.height / 10),
+                                 cv::Point(m + lores.width / 2, m + lores.height / 10 + 4),
+                                 cv::Point(m + lores.width / 2 - 3, m + lores.height / 2) };
+    double factor = 1. * lores.width / hires.cols();
+    cv::Point2f hires_corners[3];
+    for (unsigned int j = 0; j < 3; ++j)
+      hires_corners[j] = cv::Point2f((gui_corners[j].x - m) / factor,
+                                     (gui_corners[j].y - m) / factor);
+    // the region of the scan containing the postcard, for comparing the warps
+    cv::Mat3b roi_img;
+    hires.get_roi(cv::Rect(0, 0, hires.cols() * 6 / 10, hires.rows() * 6 / 10), roi_img);
+    cv::Point2f aligned_corners[3] = {
+      cv::Point2f(cvRound(hires_corners[0].x), cvRound(hires_corners[0].y)),
+      cv::Point2f(cvRound(hires_corners[1].x), cvRound(hires_corners[0].y)),
+      cv::Point2f(cvRound(hires_corners[1].x), cvRound(hires_corners[2].y)) };
+    cv::Mat3b postcard;
+    std::vector<uchar> png;
+    for (unsigned int i = 0; i < iterations; ++i) {
+      t0 = now_ms();
+      for (unsigned int j = 0; j < 3; ++j)
+        extractor.add_corner(gui_corners[j].x, gui_corners[j].y);
+      corner.add(now_ms() - t0);
+      t0 = now_ms();
+      extractor.save_current_postcard();
+      save.add(now_ms() - t0);
+      t0 = now_ms();
+      extract_postcard(hires, hires_corners, postcard);
+      warp.add(now_ms() - t0);
+      t0 = now_ms();
+      extract_postcard_opencv(roi_img, hires_corners, postcard);
+      opencv_warp.add(now_ms() - t0);
+      t0 = now_ms();
+      extract_postcard(roi_img, aligned_corners, postcard);
+      aligned_warp.add(now_ms() - t0);
+      t0 = now_ms();
+      cv::imencode(".png", postcard, png);
+      encode.add(now_ms() - t0);
+    }
+    print_memory("after scan");
+  } // end for file_idx
+  // switch between the scans, the prefetcher decoding the neighbours
+  for (unsigned int i = 0; i < iterations * filenames.size(); ++i) {
+    double t0 = now_ms();
+    extractor.goto_next_playlist_image();
+    switch_image.add(now_ms() - t0);
+    extractor.upgrade_to_full_resolution(true);
+    full_resolution.add(now_ms() - t0);
+  }
+  decode.print();
+  set_image.print();
+  zoom.print();
+  corner.print();
+  save.print();
+  warp.print();
+  opencv_warp.print();
+  aligned_warp.print();
+  encode.print();
+  switch_image.print();
+  full_resolution.print();
+  print_memory("end");
+} // end benchmark_scans()
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  std::vector<unsigned int> dpis;
+  unsigned int iterations = 3;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--check")
+      return (check_extraction(200) ? 0 : 1);
+    else if (arg == "--dpi" && i + 1 < argc)
+      dpis.push_back(atoi(argv[++i]));
+    else if (arg == "--iterations" && i + 1 < argc)
+      iterations = std::max(1, atoi(argv[++i]));
+    else {
+      printf("Synopsis\n  postcard_benchmarks [--dpi N]... [--iterations N]\n"
+             "  postcard_benchmarks --check\n");
+      return (arg == "-h" || arg == "--help" ? 0 : -1);
+    }
+  }
+  if (dpis.empty()) {
+    dpis.push_back(300);
+    dpis.push_back(600);
+    dpis.push_back(1200);
+  }
+  std::string dir = make_temp_dir();
+  if (dir.empty()) {
+    printf("Could not create a temporary folder!\n");
+    return -1;
+  }
+  print_memory("start");
+  // synthetic scans
+  for (unsigned int i = 0; i < dpis.size(); ++i) {
+    std::ostringstream title;
+    title << "Synthetic A4 scans at " << dpis[i] << " dpi";
+    std::vector<std::string> filenames;
+    for (unsigned int j = 0; j < 2; ++j) { // two scans for the playlist switch
+      cv::Mat3b scan;
+      make_synthetic_scan(dpis[i], scan);
+      std::ostringstream name;
+      name << dir << "/synthetic_" << dpis[i] << "dpi_" << j << ".jpg";
+      cv::imwrite(name.str(), scan);
+      filenames.push_back(name.str());
+    }
+    benchmark_scans(title.str(), filenames, iterations);
+  }
+  // bundled samples, copied so that the postcards are not written next to them
+  std::vector<std::string> samples;
+  for (unsigned int i = 1; i <= 3; ++i) {
+    std::ostringstream src, dst;
+    src << postcard_scan_extractor_PATH << "samples/sample" << i << ".jpg";
+    dst << dir << "/sample" << i << ".jpg";
+    if (copy_file(src.str(), dst.str()))
+      samples.push_back(dst.str());
+  }
+  if (!samples.empty())
+    benchmark_scans("Bundled samples", samples, iterations);
+  remove_dir(dir);
+  return 0;
+}
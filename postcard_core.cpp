@@ -0,0 +1,196 @@
+/*!
+  \file        postcard_core.cpp
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The implementation of PostcardCore.
+ */
+
+#include "postcard_core.h"
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <sys/stat.h>
+#include "stage_profiler.h"
+
+// the modification time with nanoseconds, named differently on macOS
+#ifdef __APPLE__
+#define POSTCARD_CORE_MTIM st_mtimespec
+#else // __APPLE__
+#define POSTCARD_CORE_MTIM st_mtim
+#endif // __APPLE__
+
+PostcardCore::PostcardCore(size_t max_cache_bytes) :
+  _max_cache_bytes(max_cache_bytes), _cache_bytes(0) {}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PostcardCore::FileStamp::FileStamp(const std::string & filename) :
+  size(0), mtime_s(0), mtime_ns(0) {
+  struct stat file_stat;
+  if (stat(filename.c_str(), &file_stat) != 0)
+    return;
+  size = file_stat.st_size;
+  mtime_s = file_stat.POSTCARD_CORE_MTIM.tv_sec;
+  mtime_ns = file_stat.POSTCARD_CORE_MTIM.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::load_scan(const std::string & scan_filename, cv::Mat3b & scan) {
+  FileStamp stamp(scan_filename);
+  CacheEntryPtr entry;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::string, CacheEntryPtr>::iterator it = _entries.find(scan_filename);
+    // a scan rewritten in place, e.g. scanned again, is decoded again
+    if (it != _entries.end() && it->second->loaded && !(it->second->stamp == stamp)) {
+      _cache_bytes -= it->second->scan.total() * it->second->scan.elemSize();
+      _lru.erase(it->second->lru_it);
+      _entries.erase(it);
+      it = _entries.end();
+    }
+    if (it != _entries.end()) {
+      entry = it->second;
+      _lru.splice(_lru.begin(), _lru, entry->lru_it);
+    }
+    else {
+      entry.reset(new CacheEntry());
+      entry->stamp = stamp;
+      _lru.push_front(scan_filename);
+      entry->lru_it = _lru.begin();
+      _entries.insert(std::make_pair(scan_filename, entry));
+    }
+  }
+  // decode outside of the cache lock, the other scans stay available
+  std::lock_guard<std::mutex> entry_lock(entry->mutex);
+  if (entry->failed) { // the thread that held the lock could not decode it
+    printf("Could not read file '%s'!\n", scan_filename.c_str());
+    return false;
+  }
+  if (!entry->loaded) {
+    {
+      ScopedStageTimer timer(StageProfiler::DECODE);
+      entry->scan = cv::imread(scan_filename, CV_LOAD_IMAGE_COLOR);
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (entry->scan.empty()) { // do not cache failures, the file may appear later
+      std::map<std::string, CacheEntryPtr>::iterator it = _entries.find(scan_filename);
+      if (it != _entries.end() && it->second == entry) {
+        _lru.erase(entry->lru_it);
+        _entries.erase(it);
+      }
+      entry->failed = true;
+      printf("Could not read file '%s'!\n", scan_filename.c_str());
+      return false;
+    }
+    entry->loaded = true;
+    _cache_bytes += entry->scan.total() * entry->scan.elemSize();
+    trim_cache();
+  }
+  scan = entry->scan;
+  return true;
+} // end load_scan()
+
+////////////////////////////////////////////////////////////////////////////////
+
+void PostcardCore::trim_cache() {
+  // the most recently used scan is always kept
+  std::list<std::string>::iterator it = _lru.end();
+  while (_cache_bytes > _max_cache_bytes && it != _lru.begin()) {
+    --it;
+    if (it == _lru.begin())
+      break;
+    CacheEntryPtr victim = _entries[*it];
+    if (!victim->loaded) // being decoded
+      continue;
+    _cache_bytes -= victim->scan.total() * victim->scan.elemSize();
+    _entries.erase(*it);
+    it = _lru.erase(it);
+  } // end while (_cache_bytes)
+} // end trim_cache()
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::extract(const std::string & scan_filename,
+                           const PostcardAnnotation & annotation,
+                           cv::Mat3b & postcard) {
+  cv::Mat3b scan;
+  return load_scan(scan_filename, scan)
+      && extract_from_scan(scan, annotation, postcard);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::extract_from_scan(const cv::Mat3b & scan,
+                                     const PostcardAnnotation & annotation,
+                                     cv::Mat3b & postcard) {
+  cv::Point2f oriented_corners[3];
+  annotation.orientation.orient_corners(annotation.corners, oriented_corners);
+  ScopedStageTimer timer(StageProfiler::EXTRACTION_WARP);
+  return extract_postcard(scan, oriented_corners, postcard);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::preview(const std::string & scan_filename,
+                           const PostcardAnnotation & annotation,
+                           unsigned int max_size,
+                           cv::Mat3b & preview) {
+  cv::Mat3b postcard;
+  if (!extract(scan_filename, annotation, postcard))
+    return false;
+  double factor = std::min(1., std::min(1. * max_size / postcard.cols,
+                                        1. * max_size / postcard.rows));
+  cv::resize(postcard, preview, cv::Size(), factor, factor, cv::INTER_AREA);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::encode(const cv::Mat3b & img, const EncoderProfile & encoder,
+                          std::vector<uchar> & buffer) {
+  ScopedStageTimer timer(StageProfiler::ENCODE_WRITE);
+  return encoder.encode(img, buffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::write(const std::string & filename, const cv::Mat3b & img,
+                         const EncoderProfile & encoder) {
+  const std::string & ext = encoder.extension();
+  bool same_format = (filename.size() >= ext.size()
+                      && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0);
+  ScopedStageTimer timer(StageProfiler::ENCODE_WRITE);
+  if (!(same_format ? encoder : EncoderProfile()).write(filename, img)) {
+    printf("Could not write '%s'!\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool PostcardCore::extract_to_file(const std::string & scan_filename,
+                                   const PostcardAnnotation & annotation,
+                                   const std::string & postcard_filename,
+                                   const EncoderProfile & encoder) {
+  cv::Mat3b postcard;
+  return extract(scan_filename, annotation, postcard)
+      && write(postcard_filename, postcard, encoder);
+}
@@ -0,0 +1,141 @@
+/*!
+  \file        tiled_image.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The extraction core, without any window: decoding of the scans,
+warp of the postcards, previews and encoding.
+All the methods of PostcardCore are thread-safe, so that a single instance
+can serve many threads, for instance in postcard_daemon and PostcardBatch.
+The GUI does not decode full scans but tiled pyramids and reduced previews,
+cf ScanPrefetcher, and only shares the extraction and encoding code.
+ */
+
+#ifndef POSTCARD_CORE_H
+#define POSTCARD_CORE_H
+
+#include <opencv2/core/core.hpp>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "encoder_profile.h"
+#include "postcard_annotations.h"
+
+class PostcardCore {
+public:
+  //! the default cap of the cache of decoded scans
+  static const size_t DEFAULT_CACHE_BYTES = 512 * 1024 * 1024;
+
+  /*!
+   * \param max_cache_bytes
+   *    the cap of the cache of decoded scans, so that the postcards
+   *    of a scan requested one after the other only decode it once
+   */
+  PostcardCore(size_t max_cache_bytes = DEFAULT_CACHE_BYTES);
+
+  /*!
+   * Decode a scan, or get it from the cache.
+   * If another thread is decoding it, wait for it.
+   * A scan rewritten since it was cached, with another size or modification
+   * time, is decoded again.
+   * \param scan
+   *    the decoded scan, shared with the cache: it must not be modified
+   * \return true if success
+   */
+  bool load_scan(const std::string & scan_filename, cv::Mat3b & scan);
+
+  /*!
+   * Extract a postcard in its orientation.
+   * \param annotation
+   *    the corners in the pixels of the scan file, cf PostcardAnnotation
+   * \return true if success
+   */
+  bool extract(const std::string & scan_filename,
+               const PostcardAnnotation & annotation,
+               cv::Mat3b & postcard);
+
+  //! extract a postcard in its orientation from a scan already decoded
+  static bool extract_from_scan(const cv::Mat3b & scan,
+                                const PostcardAnnotation & annotation,
+                                cv::Mat3b & postcard);
+
+  /*!
+   * Extract a postcard then shrink it.
+   * \param max_size
+   *    the bound of the sides of the preview
+   */
+  bool preview(const std::string & scan_filename,
+               const PostcardAnnotation & annotation,
+               unsigned int max_size,
+               cv::Mat3b & preview);
+
+  //! encode an image in memory, in the format of \a encoder
+  static bool encode(const cv::Mat3b & img, const EncoderProfile & encoder,
+                     std::vector<uchar> & buffer);
+
+  /*!
+   * Write an image in the format of the extension of \a filename.
+   * \param encoder
+   *    its parameters are used if \a filename has its extension,
+   *    otherwise the default ones of OpenCV
+   */
+  static bool write(const std::string & filename, const cv::Mat3b & img,
+                    const EncoderProfile & encoder = EncoderProfile());
+
+  //! extract a postcard and write it, cf write()
+  bool extract_to_file(const std::string & scan_filename,
+                       const PostcardAnnotation & annotation,
+                       const std::string & postcard_filename,
+                       const EncoderProfile & encoder = EncoderProfile());
+
+protected:
+  //! the size and modification time of a file, all zero if it does not exist
+  struct FileStamp {
+    FileStamp() : size(0), mtime_s(0), mtime_ns(0) {}
+    explicit FileStamp(const std::string & filename);
+    inline bool operator == (const FileStamp & o) const {
+      return size == o.size && mtime_s == o.mtime_s && mtime_ns == o.mtime_ns;
+    }
+    long long size, mtime_s, mtime_ns;
+  };
+
+  struct CacheEntry {
+    CacheEntry() : loaded(false), failed(false) {}
+    std::mutex mutex; // held while decoding
+    bool loaded;
+    bool failed; // not decoded and removed from the cache, for the waiting threads
+    FileStamp stamp; // of the file when it was decoded
+    cv::Mat3b scan;
+    std::list<std::string>::iterator lru_it;
+  };
+  typedef std::shared_ptr<CacheEntry> CacheEntryPtr;
+
+  //! evict the least recently used scans. Locked.
+  void trim_cache();
+
+  size_t _max_cache_bytes, _cache_bytes;
+  std::map<std::string, CacheEntryPtr> _entries;
+  std::list<std::string> _lru; // front: most recently used
+  std::mutex _mutex;
+}; // end class PostcardCore
+
+#endif // POSTCARD_CORE_H
@@ -0,0 +1,82 @@
+/*!
+  \file        postcard_daemon.cpp
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The extraction daemon, cf PostcardDaemon.
+
+Synopsis
+  postcard_daemon SOCKET_PATH [--threads N] [--cache-mb N] [--format PROFILE]
+                  [--profile[=FILE]]
+ */
+
+#include <signal.h>
+#include "postcard_daemon.h"
+
+PostcardDaemon* daemon_instance = NULL;
+
+void stop_daemon(int /*signal*/) {
+  if (daemon_instance)
+    daemon_instance->stop();
+}
+
+int main(int argc, char** argv) {
+  std::string socket_path;
+  unsigned int nthreads = 0;
+  size_t cache_bytes = PostcardCore::DEFAULT_CACHE_BYTES;
+  EncoderProfile encoder;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--threads" && i + 1 < argc)
+      nthreads = atoi(argv[++i]);
+    else if (arg == "--cache-mb" && i + 1 < argc)
+      cache_bytes = (size_t) atoi(argv[++i]) * 1024 * 1024;
+    else if (arg == "--format" && i + 1 < argc) {
+      if (!encoder.parse(argv[++i]))
+        return -1;
+    }
+    else if (arg == "--profile")
+      StageProfiler::instance().enable();
+    else if (arg.compare(0, 10, "--profile=") == 0)
+      StageProfiler::instance().enable(arg.substr(10));
+    else if (socket_path.empty() && arg[0] != '-')
+      socket_path = arg;
+    else { // print the synopsis
+      socket_path.clear();
+      break;
+    }
+  }
+  if (socket_path.empty()) {
+    printf("Synopsis\n"
+           "  postcard_daemon SOCKET_PATH [--threads N] [--cache-mb N] [--format PROFILE]\n"
+           "                  [--profile[=FILE]]\n"
+           "Jobs, one per line, fields separated by tabulations:\n"
+           "  SCAN_PATH  POSTCARD_PATH  x0  y0  x1  y1  x2  y2  [ROTATION  MIRRORED]\n");
+    return -1;
+  }
+  cv::setNumThreads(1); // the parallelism is across jobs
+  PostcardDaemon daemon(socket_path, nthreads, cache_bytes, encoder);
+  daemon_instance = &daemon;
+  signal(SIGINT, stop_daemon);
+  signal(SIGTERM, stop_daemon);
+  bool ok = daemon.run();
+  daemon_instance = NULL;
+  StageProfiler::instance().dump();
+  return (ok ? 0 : 1);
+}
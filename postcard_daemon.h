@@ -0,0 +1,273 @@
+/*!
+  \file        postcard_daemon.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A long-running extraction server listening on a Unix socket.
+The workers and the cache of decoded scans stay warm between the jobs,
+so that a pipeline can submit many extractions without paying
+the startup of a process for each of them.
+
+Protocol: one job per line, the fields being separated by tabulations:
+  SCAN_PATH  POSTCARD_PATH  x0  y0  x1  y1  x2  y2  [ROTATION  MIRRORED]
+where (x0, y0), (x1, y1), (x2, y2) are the top-left, top-right and
+bottom-right corners in the pixels of the scan file, and ROTATION, MIRRORED
+the orientation, cf PostcardAnnotation: ROTATION is 0, 1, 2 or 3 quarter turns,
+MIRRORED 0 or 1.
+The postcard is written in the format of the extension of POSTCARD_PATH,
+with the parameters of the encoder profile if it has its extension,
+cf EncoderProfile.
+Each job gets a reply line, in the order of completion:
+  OK     POSTCARD_PATH  WIDTHxHEIGHT
+  ERROR  POSTCARD_PATH  MESSAGE
+A client can send many jobs without waiting for the replies.
+ */
+
+#ifndef POSTCARD_DAEMON_H
+#define POSTCARD_DAEMON_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "postcard_core.h"
+#include "stage_profiler.h"
+#include "work_stealing_pool.h"
+
+class PostcardDaemon {
+public:
+  //! how often the blocking calls check if the daemon was stopped
+  static const int POLL_PERIOD_MS = 200;
+
+  PostcardDaemon(const std::string & socket_path,
+                 unsigned int nthreads = 0,
+                 size_t max_cache_bytes = PostcardCore::DEFAULT_CACHE_BYTES,
+                 const EncoderProfile & encoder = EncoderProfile()) :
+    _socket_path(socket_path), _encoder(encoder), _core(max_cache_bytes), _pool(nthreads),
+    _listen_fd(-1), _stopped(false), _nreaders(0) {}
+
+  ~PostcardDaemon() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Accept the connections until stop() is called.
+   * \return false if the socket could not be opened
+   */
+  bool run() {
+    if (!open_socket())
+      return false;
+    printf("Listening on '%s' with %i workers\n", _socket_path.c_str(), _pool.nthreads());
+    while (!_stopped) {
+      struct pollfd pfd = { _listen_fd, POLLIN, 0 };
+      if (poll(&pfd, 1, POLL_PERIOD_MS) <= 0)
+        continue;
+      int fd = accept(_listen_fd, NULL, NULL);
+      if (fd < 0)
+        continue;
+      ConnectionPtr connection(new Connection(fd));
+      {
+        std::lock_guard<std::mutex> lock(_readers_mutex);
+        ++_nreaders;
+      }
+      std::thread(&PostcardDaemon::read_jobs, this, connection).detach();
+    } // end while (!_stopped)
+    {
+      std::unique_lock<std::mutex> lock(_readers_mutex);
+      while (_nreaders > 0)
+        _readers_cond.wait(lock);
+    }
+    _pool.wait();
+    close(_listen_fd);
+    _listen_fd = -1;
+    unlink(_socket_path.c_str());
+    return true;
+  } // end run()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! make run() return once the queued jobs are done. Async-signal-safe.
+  inline void stop() { _stopped = true; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  //! a client. The socket is closed once the last reply is sent.
+  struct Connection {
+    Connection(int fd_) : fd(fd_) {}
+    ~Connection() { close(fd); }
+    inline bool reply(const std::string & line) {
+      std::lock_guard<std::mutex> lock(write_mutex);
+      size_t sent = 0;
+      while (sent < line.size()) {
+        ssize_t n = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+          return false;
+        sent += n;
+      }
+      return true;
+    }
+    int fd;
+    std::mutex write_mutex;
+  }; // end struct Connection
+  typedef std::shared_ptr<Connection> ConnectionPtr;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  bool open_socket() {
+    struct sockaddr_un addr;
+    if (_socket_path.size() >= sizeof(addr.sun_path)) {
+      printf("Socket path too long: '%s'!\n", _socket_path.c_str());
+      return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, _socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    // a socket left by a previous run, but never an other file, e.g. a mistyped scan
+    struct stat path_stat;
+    if (lstat(_socket_path.c_str(), &path_stat) == 0) {
+      if (!S_ISSOCK(path_stat.st_mode)) {
+        printf("'%s' exists and is not a socket!\n", _socket_path.c_str());
+        return false;
+      }
+      unlink(_socket_path.c_str());
+    }
+    _listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_listen_fd < 0
+        || bind(_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(_listen_fd, SOMAXCONN) != 0) {
+      printf("Could not listen on '%s': %s\n", _socket_path.c_str(), strerror(errno));
+      if (_listen_fd >= 0)
+        close(_listen_fd);
+      _listen_fd = -1;
+      return false;
+    }
+    return true;
+  } // end open_socket()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! split the stream of a client into lines and queue them as jobs
+  void read_jobs(ConnectionPtr connection) {
+    std::string buffer;
+    char chunk[4096];
+    while (!_stopped) {
+      struct pollfd pfd = { connection->fd, POLLIN, 0 };
+      if (poll(&pfd, 1, POLL_PERIOD_MS) <= 0)
+        continue;
+      ssize_t n = recv(connection->fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) // closed by the client
+        break;
+      buffer.append(chunk, n);
+      std::string::size_type end;
+      while ((end = buffer.find('\n')) != std::string::npos) {
+        std::string line = buffer.substr(0, end);
+        buffer.erase(0, end + 1);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+          line.erase(line.size() - 1);
+        if (!line.empty())
+          _pool.submit(std::bind(&PostcardDaemon::process_job, this, connection, line));
+      } // end while (end)
+    } // end while (!_stopped)
+    std::lock_guard<std::mutex> lock(_readers_mutex);
+    --_nreaders;
+    _readers_cond.notify_all();
+  } // end read_jobs()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  void process_job(ConnectionPtr connection, const std::string & line) {
+    std::vector<std::string> fields;
+    std::istringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '\t'))
+      fields.push_back(field);
+    std::string postcard_path = (fields.size() >= 2 ? fields[1] : "");
+    PostcardAnnotation annotation;
+    if (!parse_job(fields, annotation)) {
+      connection->reply("ERROR\t" + postcard_path + "\tmalformed job\n");
+      return;
+    }
+    cv::Mat3b postcard;
+    if (!_core.extract(fields[0], annotation, postcard)) {
+      connection->reply("ERROR\t" + postcard_path + "\tcould not extract\n");
+      return;
+    }
+    if (!PostcardCore::write(postcard_path, postcard, _encoder)) {
+      connection->reply("ERROR\t" + postcard_path + "\tcould not write\n");
+      return;
+    }
+    std::ostringstream ans;
+    ans << "OK\t" << postcard_path << "\t" << postcard.cols << "x" << postcard.rows << "\n";
+    connection->reply(ans.str());
+  } // end process_job()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  static bool parse_job(const std::vector<std::string> & fields,
+                        PostcardAnnotation & annotation) {
+    if ((fields.size() != 8 && fields.size() != 10) || fields[0].empty() || fields[1].empty())
+      return false;
+    double values[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (unsigned int i = 2; i < fields.size(); ++i) {
+      char* end;
+      values[i - 2] = strtod(fields[i].c_str(), &end);
+      if (end == fields[i].c_str() || *end != '\0' || !std::isfinite(values[i - 2]))
+        return false;
+    }
+    // the casts of out-of-range values are undefined
+    if (values[6] != floor(values[6]) || values[6] < 0 || values[6] > 3
+        || (values[7] != 0 && values[7] != 1))
+      return false;
+    for (unsigned int i = 0; i < 3; ++i)
+      annotation.corners[i] = cv::Point2f(values[2 * i], values[2 * i + 1]);
+    annotation.orientation = PostcardOrientation((unsigned int) values[6], values[7] != 0);
+    return true;
+  } // end parse_job()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::string _socket_path;
+  EncoderProfile _encoder;
+  PostcardCore _core;
+  WorkStealingPool _pool;
+  int _listen_fd;
+  std::atomic<bool> _stopped;
+  //! the threads reading the jobs, one per client
+  unsigned int _nreaders;
+  std::mutex _readers_mutex;
+  std::condition_variable _readers_cond;
+}; // end class PostcardDaemon
+
+#endif // POSTCARD_DAEMON_H
@@ -0,0 +1,340 @@
+/*!
+  \file        postcard_extraction.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The image processing shared by the GUI and the batch mode:
+extraction of a postcard from three of its corners,
+and automatic detection of the postcards lying on a uniform background.
+ */
+
+#ifndef POSTCARD_EXTRACTION_H
+#define POSTCARD_EXTRACTION_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Remove the extension from a filename
+ * \param path
+ *  the full path
+ * \example
+ *  "/foo/bar" -> "/foo/bar"
+ *  "/foo/bar.dat" -> "/foo/bar"
+ *  "/foo.zim/bar.dat" -> "/foo.zim/bar"
+ *  "/foo.zim/bar" -> "/foo.zim/bar"
+ */
+inline std::string remove_filename_extension(const std::string & path) {
+  std::string::size_type dot_pos = path.find_last_of('.');
+  if (dot_pos == std::string::npos)
+    return path;
+  std::string::size_type slash_pos = path.find_last_of('/');
+  if (slash_pos != std::string::npos && slash_pos > dot_pos) // dot before slash
+    return path;
+  return path.substr(0, dot_pos);
+}
+
+//! \brief   returns |ab|, L2 norm
+template<class _Pt2>
+inline double dist_L2(const _Pt2 & a, const _Pt2 & b) {
+  return hypot(a.x - b.x, a.y - b.y);
+}
+
+//! \example ("/foo/scan.jpg", "_postcard", 2) -> "/foo/scan_postcard2.png"
+inline std::string postcard_filename(const std::string & scan_filename,
+                                     const std::string & postcard_suffix,
+                                     unsigned int postcard_idx,
+                                     const std::string & extension = ".png") {
+  std::ostringstream ans;
+  ans << remove_filename_extension(scan_filename)
+      << postcard_suffix << postcard_idx << extension;
+  return ans.str();
+}
+
+//! the size of a postcard given by three consecutive corners, cf extract_postcard()
+inline cv::Size postcard_size(const cv::Point2f corners[3]) {
+  return cv::Size((int) dist_L2(corners[0], corners[1]),
+                  (int) dist_L2(corners[1], corners[2]));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! resample a postcard with cv::warpAffine(), \a postcard must be allocated
+inline void warp_postcard_opencv(const cv::Mat3b & scan,
+                                 const cv::Point2f corners[3],
+                                 cv::Mat3b & postcard) {
+  double w = dist_L2(corners[0], corners[1]);
+  double h = dist_L2(corners[1], corners[2]);
+  cv::Point2f dst [3]= { cv::Point2f(0, 0), cv::Point2f(w, 0), cv::Point2f(w, h)};
+  cv::Mat transform = cv::getAffineTransform(corners, dst);
+  cv::warpAffine(scan, postcard, transform,  postcard.size());
+}
+
+/*!
+ * Extract a postcard from a scan with cv::warpAffine(), always resampling.
+ * This is the reference of extract_postcard(), cf "postcard_benchmarks --check".
+ */
+inline bool extract_postcard_opencv(const cv::Mat3b & scan,
+                                    const cv::Point2f corners[3],
+                                    cv::Mat3b & postcard) {
+  double w = dist_L2(corners[0], corners[1]);
+  double h = dist_L2(corners[1], corners[2]);
+  if (w < 1 || h < 1)
+    return false;
+  postcard.release(); // it may share the pixels of a scan
+  postcard.create(h, w);
+  postcard.setTo(cv::Scalar::all(0));
+  warp_postcard_opencv(scan, corners, postcard);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Move the corners of a postcard whose sides are parallel to the axes
+ * of the scan within a pixel, whatever its right-angle rotation,
+ * onto the closest pixels, keeping the size postcard_size().
+ * \param snapped
+ *    the corners, on pixels, with sides exactly parallel to the axes
+ * \return false if the postcard is further from the axes
+ */
+inline bool snap_axis_aligned_corners(const cv::Point2f corners[3],
+                                      cv::Point2f snapped[3]) {
+  // the largest offset across a side, invisible on the postcard
+  static const float MAX_SKEW = 1;
+  cv::Point2f u = corners[1] - corners[0], v = corners[2] - corners[1];
+  bool u_horizontal = (fabs(u.y) <= MAX_SKEW && fabs(v.x) <= MAX_SKEW
+                       && fabs(u.x) >= fabs(u.y)),
+      u_vertical = (!u_horizontal && fabs(u.x) <= MAX_SKEW && fabs(v.y) <= MAX_SKEW
+                    && fabs(u.y) >= fabs(u.x));
+  if (!u_horizontal && !u_vertical)
+    return false;
+  cv::Size size = postcard_size(corners);
+  cv::Point2f u_dir = (u_horizontal ? cv::Point2f(u.x > 0 ? 1 : -1, 0)
+                                    : cv::Point2f(0, u.y > 0 ? 1 : -1)),
+      v_dir = (u_horizontal ? cv::Point2f(0, v.y > 0 ? 1 : -1)
+                            : cv::Point2f(v.x > 0 ? 1 : -1, 0));
+  snapped[0] = cv::Point2f(cvRound(corners[0].x), cvRound(corners[0].y));
+  snapped[1] = snapped[0] + (float) size.width * u_dir;
+  snapped[2] = snapped[1] + (float) size.height * v_dir;
+  return true;
+} // end snap_axis_aligned_corners()
+
+/*!
+ * Extract a postcard whose sides are parallel to the axes of the scan
+ * within a pixel, whatever its right-angle rotation.
+ * No resampling is needed: the corners are snapped to the closest pixels,
+ * cf snap_axis_aligned_corners(), and the postcard is a view of the scan,
+ * transposed and flipped if needed. It has the same pixels
+ * as extract_postcard_opencv() with the snapped corners.
+ * \param postcard
+ *    the postcard. If not rotated, it shares the pixels of \a scan.
+ * \return false if the postcard is not axis-aligned or not fully inside the scan
+ */
+inline bool extract_axis_aligned_postcard(const cv::Mat3b & scan,
+                                          const cv::Point2f input_corners[3],
+                                          cv::Mat3b & postcard) {
+  cv::Point2f corners[3];
+  if (!snap_axis_aligned_corners(input_corners, corners))
+    return false;
+  cv::Point2f u = corners[1] - corners[0], v = corners[2] - corners[1];
+  bool u_horizontal = (u.y == 0 && v.x == 0), u_vertical = !u_horizontal;
+  // the same size as the warp
+  int w = dist_L2(corners[0], corners[1]), h = dist_L2(corners[1], corners[2]);
+  if (w < 1 || h < 1)
+    return false;
+  int x0 = cvRound(corners[0].x), y0 = cvRound(corners[0].y);
+  // the postcard pixel (i, j) is the scan pixel (x0, y0) + i * u_dir + j * v_dir
+  bool u_positive = (u_horizontal ? u.x > 0 : u.y > 0),
+      v_positive = (u_horizontal ? v.y > 0 : v.x > 0);
+  int u_start = (u_horizontal ? x0 : y0), v_start = (u_horizontal ? y0 : x0);
+  if (!u_positive)
+    u_start -= w - 1;
+  if (!v_positive)
+    v_start -= h - 1;
+  cv::Rect roi = (u_horizontal ? cv::Rect(u_start, v_start, w, h)
+                               : cv::Rect(v_start, u_start, h, w));
+  if ((roi & cv::Rect(0, 0, scan.cols, scan.rows)) != roi)
+    return false;
+  cv::Mat3b view = scan(roi);
+  if (postcard.datastart == scan.datastart)
+    postcard.release();
+  if (u_vertical) { // postcard row j is scan column v_start + j
+    cv::transpose(view, postcard);
+    view = postcard;
+  }
+  if (!u_positive && !v_positive)
+    cv::flip(view, postcard, -1);
+  else if (!u_positive)
+    cv::flip(view, postcard, 1);
+  else if (!v_positive)
+    cv::flip(view, postcard, 0);
+  else
+    postcard = view; // zero-copy
+  return true;
+} // end extract_axis_aligned_postcard()
+
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Extract a postcard from a scan.
+ * The postcards axis-aligned within a pixel are copied,
+ * cf extract_axis_aligned_postcard(), the other ones resampled with cv::warpAffine().
+ * \param scan
+ *    the full resolution scan
+ * \param corners
+ *    three consecutive corners of the postcard in \a scan:
+ *    top-left, top-right, bottom-right
+ * \param postcard
+ *    the straightened postcard. It can share the pixels of \a scan.
+ *    If it is given with the size postcard_size(corners) and does not share
+ *    the pixels of \a scan, it is written in place, without allocation:
+ *    it must not be used elsewhere, for instance by a PostcardWriter.
+ * \return true if success
+ */
+inline bool extract_postcard(const cv::Mat3b & scan,
+                             const cv::Point2f corners[3],
+                             cv::Mat3b & postcard) {
+  double w = dist_L2(corners[0], corners[1]);
+  double h = dist_L2(corners[1], corners[2]);
+  if (w < 1 || h < 1)
+    return false;
+  if (extract_axis_aligned_postcard(scan, corners, postcard))
+    return true;
+  if (postcard.datastart == scan.datastart) // it shares the pixels of the scan
+    postcard.release();
+  postcard.create(h, w);
+  warp_postcard_opencv(scan, corners, postcard);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! sort the corners of a rectangle by angle around its center
+inline bool compare_angles(const std::pair<float, cv::Point2f> & a,
+                           const std::pair<float, cv::Point2f> & b) {
+  return a.first < b.first;
+}
+
+//! sort the postcards from top to bottom, then from left to right
+inline bool compare_postcard_positions(const std::vector<cv::Point2f> & a,
+                                       const std::vector<cv::Point2f> & b) {
+  if (a.front().y != b.front().y)
+    return a.front().y < b.front().y;
+  return a.front().x < b.front().x;
+}
+
+/*!
+ * Find the postcards lying on a uniform background.
+ * The background color is estimated on the border of the scan,
+ * the pixels that differ from it are grouped into blobs
+ * and each big enough blob gives a postcard.
+ * \param scan
+ *    the full resolution scan
+ * \param corners
+ *    for each postcard, its top-left, top-right and bottom-right corners
+ *    in \a scan, in the order expected by extract_postcard()
+ * \param min_area_ratio
+ *    the minimum area of a postcard, as a fraction of the scan area
+ * \return the number of postcards found
+ */
+inline unsigned int detect_postcards(const cv::Mat3b & scan,
+                                     std::vector< std::vector<cv::Point2f> > & corners,
+                                     double min_area_ratio = .01) {
+  static const double WORK_SIZE = 1000; // max side of the image processed
+  corners.clear();
+  if (scan.empty())
+    return 0;
+  // work on a small version of the scan
+  double factor = std::min(1., WORK_SIZE / std::max(scan.cols, scan.rows));
+  cv::Mat3b small;
+  cv::resize(scan, small, cv::Size(), factor, factor, cv::INTER_AREA);
+  // background color = median color of the border
+  unsigned int border = std::max(2, std::min(small.cols, small.rows) / 50);
+  std::vector<uchar> border_values[3];
+  for (int row = 0; row < small.rows; ++row) {
+    for (int col = 0; col < small.cols; ++col) {
+      if (row >= (int) border && row < small.rows - (int) border
+          && col == (int) border) // jump to the right border
+        col = small.cols - border;
+      const cv::Vec3b & pix = small(row, col);
+      for (unsigned int c = 0; c < 3; ++c)
+        border_values[c].push_back(pix[c]);
+    } // end for col
+  } // end for row
+  cv::Scalar bg;
+  for (unsigned int c = 0; c < 3; ++c) {
+    std::vector<uchar> & v = border_values[c];
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    bg[c] = v[v.size() / 2];
+  }
+  // distance to background = max channel difference
+  cv::Mat3b diff;
+  cv::absdiff(small, bg, diff);
+  cv::Mat1b diff_channels[3], mask;
+  cv::split(diff, diff_channels);
+  cv::max(diff_channels[0], diff_channels[1], mask);
+  cv::max(mask, diff_channels[2], mask);
+  cv::threshold(mask, mask, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+  // fill the postcards and remove the dust
+  int ksize = std::max(3, std::min(small.cols, small.rows) / 60);
+  cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(ksize, ksize));
+  cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel);
+  cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel);
+  // one postcard per big blob
+  std::vector< std::vector<cv::Point> > contours;
+  cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+  double min_area = min_area_ratio * small.cols * small.rows;
+  for (unsigned int i = 0; i < contours.size(); ++i) {
+    if (cv::contourArea(contours[i]) < min_area)
+      continue;
+    cv::RotatedRect rect = cv::minAreaRect(contours[i]);
+    cv::Point2f pts[4];
+    rect.points(pts);
+    // sort clockwise (y axis pointing down), starting from the top-left one
+    std::vector< std::pair<float, cv::Point2f> > angles;
+    for (unsigned int j = 0; j < 4; ++j)
+      angles.push_back(std::make_pair(atan2(pts[j].y - rect.center.y,
+                                            pts[j].x - rect.center.x),
+                                      pts[j] * (1. / factor)));
+    std::sort(angles.begin(), angles.end(), compare_angles);
+    unsigned int tl = 0;
+    for (unsigned int j = 1; j < 4; ++j) {
+      if (angles[j].second.x + angles[j].second.y
+          < angles[tl].second.x + angles[tl].second.y)
+        tl = j;
+    }
+    std::vector<cv::Point2f> postcard_corners;
+    for (unsigned int j = 0; j < 3; ++j)
+      postcard_corners.push_back(angles[(tl + j) % 4].second);
+    corners.push_back(postcard_corners);
+  } // end for i
+  std::sort(corners.begin(), corners.end(), compare_postcard_positions);
+  return corners.size();
+} // end detect_postcards()
+
+#endif // POSTCARD_EXTRACTION_H
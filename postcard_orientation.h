@@ -0,0 +1,122 @@
+/*!
+  \file        postcard_orientation.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The orientation of a postcard, as an element of the symmetry group
+of the square (4 rotations, each optionally mirrored).
+Rotations and flips are composed without touching any pixel,
+and the final orientation is folded into the extraction warp
+by choosing which corners of the scan go to the corners of the postcard.
+ */
+
+#ifndef POSTCARD_ORIENTATION_H
+#define POSTCARD_ORIENTATION_H
+
+#include <opencv2/core/core.hpp>
+
+class PostcardOrientation {
+public:
+  /*!
+   * The corners of the postcard are numbered clockwise:
+   * 0:top-left, 1:top-right, 2:bottom-right, 3:bottom-left.
+   * The oriented corner i is the original corner
+   * (rotation + i) % 4 if not mirrored, (rotation - i) % 4 if mirrored.
+   */
+  PostcardOrientation(unsigned int rotation = 0, bool mirrored = false) :
+    _rotation(rotation % 4), _mirrored(mirrored) {}
+
+  //! rotate of 90° counter-clockwise
+  static PostcardOrientation rotate_left() { return PostcardOrientation(1, false); }
+  //! flip around the vertical axis
+  static PostcardOrientation flip_left_right() { return PostcardOrientation(1, true); }
+  //! flip around the horizontal axis
+  static PostcardOrientation flip_top_bottom() { return PostcardOrientation(3, true); }
+
+  inline unsigned int rotation() const { return _rotation; }
+  inline bool mirrored() const { return _mirrored; }
+  inline bool is_identity() const { return _rotation == 0 && !_mirrored; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the index of the original corner that becomes the corner \a i
+  inline unsigned int corner_map(unsigned int i) const {
+    return (_mirrored ? _rotation + 4 - i % 4 : _rotation + i) % 4;
+  }
+
+  //! \return the orientation obtained by applying this one, then \a next
+  inline PostcardOrientation then(const PostcardOrientation & next) const {
+    unsigned int rotation = (_mirrored ? _rotation + 4 - next._rotation
+                                       : _rotation + next._rotation);
+    return PostcardOrientation(rotation, _mirrored != next._mirrored);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Reorder the corners of a postcard, for extract_postcard().
+   * \param corners
+   *    the top-left, top-right and bottom-right corners in the scan,
+   *    as clicked by the user
+   * \param oriented_corners
+   *    the corners of the scan that go to the top-left, top-right
+   *    and bottom-right corners of the oriented postcard
+   */
+  inline void orient_corners(const cv::Point2f corners[3],
+                             cv::Point2f oriented_corners[3]) const {
+    cv::Point2f all_corners[4] = { corners[0], corners[1], corners[2],
+                                   corners[0] + corners[2] - corners[1] };
+    for (unsigned int i = 0; i < 3; ++i)
+      oriented_corners[i] = all_corners[corner_map(i)];
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Orient an image with transposes and flips.
+   * Meant for small images such as thumbnails, the full resolution postcards
+   * are oriented within the warp by orient_corners().
+   */
+  inline void orient_image(const cv::Mat3b & in, cv::Mat3b & out) const {
+    // the rotation first, then the mirror, which is a transpose
+    if (_rotation == 0)
+      in.copyTo(out);
+    else if (_rotation == 1) { // counter-clockwise
+      cv::transpose(in, out);
+      cv::flip(out, out, 0);
+    }
+    else if (_rotation == 2)
+      cv::flip(in, out, -1);
+    else { // clockwise
+      cv::transpose(in, out);
+      cv::flip(out, out, 1);
+    }
+    if (_mirrored) {
+      cv::Mat3b buffer;
+      cv::transpose(out, buffer);
+      out = buffer;
+    }
+  } // end orient_image()
+
+protected:
+  unsigned int _rotation;
+  bool _mirrored;
+}; // end class PostcardOrientation
+
+#endif // POSTCARD_ORIENTATION_H
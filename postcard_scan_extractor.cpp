@@ -24,18 +24,137 @@ A simple GUI for PostcardScanExtractors.
  */
 
 #include "postcard_scan_extractor.h"
+#include "postcard_batch.h"
+
+//! time the encoder profiles on the first postcard of a scan, or on the scan
+bool measure_encoders(const std::string & filename) {
+  cv::Mat3b sample = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+  if (sample.empty()) {
+    printf("Could not read file '%s'!\n", filename.c_str());
+    return false;
+  }
+  std::vector<PostcardAnnotation> annotations;
+  if (has_annotations(filename)
+      && load_annotations(filename, annotations) && !annotations.empty()) {
+    cv::Point2f oriented_corners[3];
+    annotations.front().orientation.orient_corners(annotations.front().corners,
+                                                   oriented_corners);
+    cv::Mat3b postcard;
+    if (extract_postcard(sample, oriented_corners, postcard))
+      sample = postcard.clone();
+  }
+  measure_encoder_profiles(sample, EncoderProfile::builtin_profiles());
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! replay a recorded session without window and print its frame latencies
+bool replay_events(const std::string & events_filename,
+                   const EncoderProfile & encoder,
+                   const std::vector<PostcardVariant> & variants,
+                   const std::string & cache_dir, size_t cache_mb) {
+  std::vector<std::string> playlist;
+  std::vector<InputEvent> events;
+  if (!load_input_events(events_filename, playlist, events) || playlist.empty())
+    return false;
+  PostcardScanExtractor annot("_postcard", false);
+  annot.set_encoder_profile(encoder);
+  for (unsigned int i = 0; i < variants.size(); ++i)
+    annot.add_postcard_variant(variants[i]);
+  annot.enable_disk_cache(cache_dir, cache_mb * 1024 * 1024);
+  if (!annot.load_playlist_images(playlist))
+    return false;
+  printf("Replaying %i events on %i scans\n", (int) events.size(), (int) playlist.size());
+  std::vector<double> latencies_ms;
+  annot.replay_input_events(events, latencies_ms);
+  print_frame_latencies(events, latencies_ms, events_filename + ".latency.csv");
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
 int main(int argc, char** argv) {
   std::vector<std::string> filenames;
+  bool batch = false, replay = false, measure = false, snap = false, force = false;
+  EncoderProfile encoder;
+  std::vector<PostcardVariant> variants;
+  unsigned int nthreads = 0;
+  std::string cache_dir = ScanDiskCache::default_dir();
+  size_t cache_mb = PostcardScanExtractor::DEFAULT_DISK_CACHE_MB;
+  std::string watch_dir, record_filename, replay_filename;
 #if 0
   filenames.push_back(POSTCARD_SCAN_EXTRACTOR_PATH "samples/sample2.jpg");
   filenames.push_back(POSTCARD_SCAN_EXTRACTOR_PATH "samples/sample1.jpg");
   filenames.push_back(POSTCARD_SCAN_EXTRACTOR_PATH "samples/sample3.jpg");
   PostcardScanExtractor annot;
 #else
-  for (unsigned int i = 1; i < argc; ++i)
-    filenames.push_back(std::string(argv[i]));
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--batch")
+      batch = true;
+    else if (arg == "--replay")
+      replay = true;
+    else if (arg == "--force")
+      force = true;
+    else if (arg == "--threads" && i + 1 < argc)
+      nthreads = atoi(argv[++i]);
+    else if (arg == "--cache-dir" && i + 1 < argc)
+      cache_dir = argv[++i];
+    else if (arg == "--cache-size-mb" && i + 1 < argc)
+      cache_mb = atoi(argv[++i]);
+    else if (arg == "--format" && i + 1 < argc) {
+      if (!encoder.parse(argv[++i]))
+        return 1;
+    }
+    else if (arg == "--variant" && i + 1 < argc) {
+      variants.push_back(PostcardVariant());
+      if (!variants.back().parse(argv[++i]))
+        return 1;
+    }
+    else if (arg == "--snap")
+      snap = true;
+    else if (arg == "--measure-encoders")
+      measure = true;
+    else if (arg == "--record-events" && i + 1 < argc)
+      record_filename = argv[++i];
+    else if (arg == "--replay-events" && i + 1 < argc)
+      replay_filename = argv[++i];
+    else if (arg == "--watch" && i + 1 < argc)
+      watch_dir = argv[++i];
+    else if (arg == "--profile")
+      StageProfiler::instance().enable();
+    else if (arg.compare(0, 10, "--profile=") == 0)
+      StageProfiler::instance().enable(arg.substr(10));
+    else
+      filenames.push_back(arg);
+  }
+  if (measure) {
+    std::string sample = (filenames.empty() ?
+                            postcard_scan_extractor_PATH "samples/sample1.jpg"
+                          : filenames.front());
+    return (measure_encoders(sample) ? 0 : 1);
+  }
+  if (!replay_filename.empty())
+    return (replay_events(replay_filename, encoder, variants, cache_dir, cache_mb) ? 0 : 1);
+  if ((batch || replay) && !filenames.empty()) {
+    PostcardBatch postcard_batch("_postcard", nthreads, replay, encoder, force);
+    for (unsigned int i = 0; i < variants.size(); ++i)
+      postcard_batch.add_postcard_variant(variants[i]);
+    bool ok = postcard_batch.run(filenames);
+    StageProfiler::instance().dump();
+    return (ok ? 0 : 1);
+  }
   PostcardScanExtractor annot;
+  annot.set_encoder_profile(encoder);
+  for (unsigned int i = 0; i < variants.size(); ++i)
+    annot.add_postcard_variant(variants[i]);
+  annot.set_corner_snapping(snap);
+  annot.enable_disk_cache(cache_dir, cache_mb * 1024 * 1024);
+  if (!watch_dir.empty() && !annot.watch_folder(watch_dir, filenames))
+    return 1;
+  if (!record_filename.empty())
+    annot.record_input_events(record_filename);
 #endif
   annot.load_playlist_images(filenames);
   annot.run();
@@ -29,47 +29,39 @@ ________________________________________________________________________________
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <stdio.h>
+#include <chrono>
 #include <iostream>
+#include <set>
+#include <thread>
 #include "postcard_scan_extractor_path.h"
+#include "corner_snapping.h"
+#include "encoder_profile.h"
+#include "hot_folder_watcher.h"
+#include "input_events.h"
+#include "postcard_annotations.h"
+#include "postcard_extraction.h"
+#include "postcard_orientation.h"
+#include "postcard_variants.h"
+#include "postcard_writer.h"
+#include "scan_prefetcher.h"
+#include "stage_profiler.h"
 
 #define DEBUG_PRINT(...)   {}
 //#define DEBUG_PRINT(...)   printf(__VA_ARGS__)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-/*!
- * Remove the extension from a filename
- * \param path
- *  the full path
- * \example
- *  "/foo/bar" -> "/foo/bar"
- *  "/foo/bar.dat" -> "/foo/bar"
- *  "/foo.zim/bar.dat" -> "/foo.zim/bar"
- *  "/foo.zim/bar" -> "/foo.zim/bar"
- */
-inline std::string remove_filename_extension(const std::string & path) {
-  std::string::size_type dot_pos = path.find_last_of('.');
-  if (dot_pos == std::string::npos)
-    return path;
-  std::string::size_type slash_pos = path.find_last_of('/');
-  if (slash_pos != std::string::npos && slash_pos > dot_pos) // dot before slash
-    return path;
-  return path.substr(0, dot_pos);
-}
-
-//! \brief   returns |ab|, L2 norm
-template<class _Pt2>
-inline double dist_L2(const _Pt2 & a, const _Pt2 & b) {
-  return hypot(a.x - b.x, a.y - b.y);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
 class PostcardScanExtractor {
 public:
   static const unsigned int WINDOW_WIDTH = 800, WINDOW_HEIGHT = 600, MARGIN_SIZE = 10;
   static const unsigned int ZOOM_WINDOW_SIZE  = 200;
-  static const double DEFAULT_ZOOM_LEVEL = 50;
+  static constexpr double DEFAULT_ZOOM_LEVEL = 50;
+  //! the events received during a frame are rendered at once at its end
+  static const int FRAME_PERIOD_MS = 20;
+  //! memory cap of the cache of decoded scans
+  static const size_t PREFETCH_CACHE_BYTES = 1024 * 1024 * 1024;
+  //! default size limit of the disk cache of prepared scans, in MB
+  static const size_t DEFAULT_DISK_CACHE_MB = 10 * 1024;
 
   struct Line {
     static Line perpendicular_at_point(const cv::Point & A,
@@ -98,29 +90,131 @@ public:
     cv::Vec2i _vec;
   }; ///////////////////////////////////////////////////////////////////////////
 
-  PostcardScanExtractor(const std::string & postcard_suffix = "_postcard") :
+  //! a cross made of segments of alternating colors, drawn from cached rows
+  struct BicolorCross {
+    static const int STEP = 10; // length of a segment
+
+    BicolorCross() {}
+    BicolorCross(const cv::Scalar & color1, const cv::Scalar & color2) :
+      _color1(color1), _color2(color2) {}
+
+    //! draw the cross at (x, y), the parts out of \a img are skipped
+    void draw(cv::Mat3b & img, int x, int y) {
+      if (_row_pattern.cols != img.cols || _col_pattern.rows != img.rows)
+        build_patterns(img.cols, img.rows);
+      if (y >= 0 && y < img.rows) {
+        cv::Mat3b img_row = img.row(y);
+        _row_pattern.copyTo(img_row);
+      }
+      if (x >= 0 && x < img.cols) {
+        cv::Mat3b img_col = img.col(x);
+        _col_pattern.copyTo(img_col);
+      }
+    }
+
+  protected:
+    //! the vertical line goes on alternating from where the horizontal one ended
+    void build_patterns(int ncols, int nrows) {
+      cv::Vec3b c1(_color1[0], _color1[1], _color1[2]),
+          c2(_color2[0], _color2[1], _color2[2]);
+      _row_pattern.create(1, ncols);
+      for (int col = 0; col < ncols; ++col)
+        _row_pattern(0, col) = ((col / STEP) % 2 == 0 ? c1 : c2);
+      int nsegments = (ncols + STEP - 1) / STEP;
+      if (nsegments % 2 == 1)
+        std::swap(c1, c2);
+      _col_pattern.create(nrows, 1);
+      for (int row = 0; row < nrows; ++row)
+        _col_pattern(row, 0) = ((row / STEP) % 2 == 0 ? c1 : c2);
+    }
+
+    cv::Scalar _color1, _color2;
+    cv::Mat3b _row_pattern, _col_pattern;
+  }; ///////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param with_gui
+   *    if false, no window is created: the images are computed but never shown,
+   *    for instance for benchmarking
+   */
+  PostcardScanExtractor(const std::string & postcard_suffix = "_postcard",
+                        bool with_gui = true) :
     MAIN_WINDOW_NAME("PostcardScanExtractor"),
-    _postcard_suffix(postcard_suffix)
+    _postcard_suffix(postcard_suffix),
+    _prefetcher(WINDOW_WIDTH, WINDOW_HEIGHT, ZOOM_WINDOW_SIZE, PREFETCH_CACHE_BYTES)
   {
     DEBUG_PRINT("ctor\n");
     // declare window
-    cv::namedWindow(MAIN_WINDOW_NAME);
-    cv::setMouseCallback(MAIN_WINDOW_NAME, PostcardScanExtractor::win_cb, this);
+    if (with_gui) {
+      cv::namedWindow(MAIN_WINDOW_NAME);
+      cv::setMouseCallback(MAIN_WINDOW_NAME, PostcardScanExtractor::win_cb, this);
+    }
     // create default images
-    _scan_img_hires.create(WINDOW_HEIGHT, WINDOW_WIDTH);
-    _scan_img_hires.setTo(cv::Scalar::all(255));
+    cv::Mat3b blank_scan(WINDOW_HEIGHT, WINDOW_WIDTH, cv::Vec3b(255, 255, 255));
     _zoom_img.create(ZOOM_WINDOW_SIZE, ZOOM_WINDOW_SIZE);
     _zoom_level = DEFAULT_ZOOM_LEVEL;
     _last_mouse_x = _last_mouse_y = 0;
     _cross_color1 = CV_RGB(255, 0, 0);
     _cross_color2 = CV_RGB(0, 0, 0);
+    _scan_cross = BicolorCross(_cross_color1, _cross_color2);
+    _zoom_cross = BicolorCross(_cross_color1, _cross_color2);
+    _zoom_needed = _redraw_needed = _zoom_changed = _window_changed = false;
+    _snap_to_corners = _snapped = false;
+    _postcard_pending = false;
+    _quit = false;
+    _replaying = false;
+    _record_start_ms = 0;
     // playlist
     _playlist_idx = 0;
-    set_image(_scan_img_hires.clone());
+    set_image(blank_scan);
   } // end ctor
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! the format of the postcards, PNG by default
+  inline void set_encoder_profile(const EncoderProfile & encoder) {
+    _encoder = encoder;
+    _writer.set_encoder_profile(encoder);
+  }
+
+  //! also write each postcard at a smaller size, cf PostcardVariant
+  inline void add_postcard_variant(const PostcardVariant & variant) {
+    _variants.push_back(variant);
+  }
+
+  //! move the clicked corners to the nearest corner of the zoom window, cf CornerSnapper
+  inline void set_corner_snapping(bool enabled) {
+    _snap_to_corners = enabled;
+    request_zoom_and_redraw();
+  }
+
+  //! keep the prepared scans between sessions, cf ScanDiskCache::enable()
+  inline bool enable_disk_cache(const std::string & dir, size_t max_bytes) {
+    return _prefetcher.enable_disk_cache(dir, max_bytes);
+  }
+
+  /*!
+   * Append the scans of a folder to the playlist while the program runs.
+   * \param playlist
+   *    the scans already in the folder are appended to it,
+   *    before it is given to load_playlist_images().
+   *    The ones it already contains, under another spelling, are skipped.
+   */
+  inline bool watch_folder(const std::string & dir, std::vector<std::string> & playlist) {
+    std::vector<std::string> existing_scans;
+    if (!_watcher.watch(dir, _postcard_suffix, existing_scans))
+      return false;
+    std::set<std::string> playlist_paths;
+    for (unsigned int i = 0; i < playlist.size(); ++i)
+      playlist_paths.insert(HotFolderWatcher::canonical_path(playlist[i]));
+    for (unsigned int i = 0; i < existing_scans.size(); ++i)
+      if (playlist_paths.insert(HotFolderWatcher::canonical_path(existing_scans[i])).second)
+        playlist.push_back(existing_scans[i]);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
   inline bool load_playlist_images(const std::vector<std::string> & playlist) {
     DEBUG_PRINT("load_playlist_images(%i images)\n", playlist.size());
     bool contains_help = (std::find(playlist.begin(), playlist.end(), std::string("--help"))
@@ -128,13 +222,57 @@ public:
         ||
         (std::find(playlist.begin(), playlist.end(), std::string("-h"))
          != playlist.end());
+    if (playlist.empty() && !contains_help && _watcher.is_watching()) {
+      printf("Waiting for scans in '%s'.\n", _watcher.dir().c_str());
+      return true;
+    }
     if (playlist.empty() || contains_help) {
       // printf("Cannot load an empty playlist! Exiting.\n");
       // print help
       std::cout << "Synopsis" << std::endl
                 << "  postcard_scan_extractor INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --batch [--threads N] [--force] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --replay [--threads N] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --profile[=FILE] [...] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor [--cache-dir DIR] [--cache-size-mb N] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --watch DIR [INPUTFILES]" << std::endl
+                << "  postcard_scan_extractor --format PROFILE [...] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --variant SUFFIX:MAX_SIZE[:PROFILE] [...] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --snap [...] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --measure-encoders [INPUTFILE]" << std::endl
+                << "  postcard_scan_extractor --record-events LOG [...] INPUTFILES" << std::endl
+                << "  postcard_scan_extractor --replay-events LOG" << std::endl
                 << "Description" << std::endl
                 << "  INPUTFILES  can be any file read by OpenCV, notably JPEGs, PNGs, BMPs, etc." << std::endl
+                << "  --batch     no GUI: detect the postcards lying on a uniform background" << std::endl
+                << "              and extract them automatically. The scans that already" << std::endl
+                << "              have a sidecar are skipped and the existing postcards" << std::endl
+                << "              are not overwritten, unless --force is given" << std::endl
+                << "  --replay    no GUI: extract again the postcards saved in the sidecars" << std::endl
+                << "              of the scans (\"scan.postcards\" for \"scan.jpg\")" << std::endl
+                << "  --threads N number of scans processed in parallel in batch or replay mode" << std::endl
+                << "              (default: one per core)" << std::endl
+                << "  --profile   time the main stages and print a summary when exiting," << std::endl
+                << "              or write it in FILE, as CSV (.csv) or JSON (.json)" << std::endl
+                << "  --cache-dir DIR    where the prepared scans are kept between sessions" << std::endl
+                << "              (default: ~/.cache/postcard_scan_extractor)" << std::endl
+                << "  --cache-size-mb N  size limit of this cache, 0 disables it" << std::endl
+                << "              (default: " << DEFAULT_DISK_CACHE_MB << ")" << std::endl
+                << "  --watch DIR the scans of DIR are added to INPUTFILES, and the new ones" << std::endl
+                << "              are appended to them as soon as they are completely written" << std::endl
+                << "  --format PROFILE  the format of the postcards (default: png):" << std::endl
+                << "              png[:LEVEL], jpeg[:QUALITY][:optimize]," << std::endl
+                << "              webp[:QUALITY|:lossless] or tiff" << std::endl
+                << "  --variant SUFFIX:MAX_SIZE[:PROFILE]  also write each postcard with SUFFIX," << std::endl
+                << "              its sides being at most MAX_SIZE, in PROFILE (default: png)." << std::endl
+                << "              Can be repeated, for instance --variant _web:1600:jpeg:85" << std::endl
+                << "  --snap      start with the snapping of the corners enabled, cf 's'" << std::endl
+                << "  --measure-encoders  time the formats on the first postcard of INPUTFILE" << std::endl
+                << "              (or on the whole scan if it has no sidecar) and exit" << std::endl
+                << "  --record-events LOG  write the keys and mouse events of the session in LOG" << std::endl
+                << "  --replay-events LOG  no GUI: replay a recorded session and print the time" << std::endl
+                << "              from each event to the end of the rendering of its frame," << std::endl
+                << "              written for each event in LOG.latency.csv" << std::endl
                 << std::endl
                 << "Keys:" << std::endl
                 << "  MOUSE MOVE:             move cursor" << std::endl
@@ -147,106 +285,182 @@ public:
                 << "  'r':                    rotate last postcard of 90°" << std::endl
                 << "  'f','v':                flip last postcard vertically" << std::endl
                 << "  'h':                    flip last postcard horizontally" << std::endl
+                << "  's':                    snap the corners to the postcard corners, on/off" << std::endl
                 << "  'q', ESCAPE:            exit program" << std::endl;
       quit();
+      return false;
     }
     _playlist = playlist;
+    _playlist_paths.clear();
+    for (unsigned int i = 0; i < _playlist.size(); ++i)
+      _playlist_paths.insert(HotFolderWatcher::canonical_path(_playlist[i]));
     return goto_playlist_image(0);
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
   inline bool goto_next_playlist_image() {
+    if (_playlist.empty())
+      return false;
     unsigned int image_idx = (_playlist_idx + 1) % _playlist.size();
     return goto_playlist_image(image_idx);
   }
   inline bool goto_prev_playlist_image() {
+    if (_playlist.empty())
+      return false;
     unsigned int image_idx = (_playlist_idx + _playlist.size() - 1) % _playlist.size();
     return goto_playlist_image(image_idx);
   }
   inline bool goto_playlist_image(unsigned int playlist_idx) {
     if (playlist_idx < 0 || playlist_idx >= _playlist.size())
       return false;
+    save_current_postcard(); // needs the filename of the previous scan
     _playlist_idx = playlist_idx;
-    return load_playlist_image(get_current_filename());
+    bool ok = load_playlist_image(get_current_filename());
+    // decode the full resolution of this scan if needed,
+    // then the neighbours while the user works on this scan
+    std::vector<std::string> neighbours;
+    neighbours.push_back(get_current_filename());
+    neighbours.push_back(_playlist[(_playlist_idx + 1) % _playlist.size()]);
+    neighbours.push_back(_playlist[(_playlist_idx + _playlist.size() - 1) % _playlist.size()]);
+    _prefetcher.prefetch(neighbours);
+    return ok;
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! process the events until quit() is called
   inline void run() {
-    while(true) {
-      cv::imshow(MAIN_WINDOW_NAME, _final_window);
-      char c = cv::waitKey(50);
-      int i = (int) c;
-      //DEBUG_PRINT("c:%c = %i\n", c, i);
-
-      if (c == 'p' || c == 8) // || c == 81 || i == 85) // 81:left | 85:PageUp | 8:backspace
-        goto_prev_playlist_image();
-      else if (c == 'n' || c == ' ') // || c == 83 || i == 86) // 83:right | 86:PageDown
-        goto_next_playlist_image();
-
-      else if (i == 81) { // left
-        _last_mouse_x -= .5;
-        recompute_zoom_and_redraw();
-      }
-      else if (i == 83) { // right
-        _last_mouse_x += .5;
-        recompute_zoom_and_redraw();
-      }
-      else if (i == 82) { // up
-        _last_mouse_y -= .5;
-        recompute_zoom_and_redraw();
-      }
-      else if (i == 84) { // down
-        _last_mouse_y += .5;
-        recompute_zoom_and_redraw();
-      }
-      else if (c == '+' || i == -85) { // -85:'+' keypad
-        _zoom_level = cv::max(_zoom_level - 1, 1.);
-        recompute_zoom_and_redraw();
-      }
-      else if (c == '-' || i == -83) { // -83:'-' keypad
-        ++_zoom_level;
-        recompute_zoom_and_redraw();
-      }
-      else if (i == 10 || i == -115) { // return | keypad return
-        add_corner(_last_mouse_x, _last_mouse_y);
-      }
-      else if (c == 'r' && !_postcard.empty()) { // rotate postcard 90°
-        cv::transpose(_postcard, _postcard_buffer);
-        cv::flip(_postcard_buffer, _postcard, 0);
-        save_current_postcard();
-      }
-      else if ((c == 'f'|| c=='v') && !_postcard.empty()) { // flip postcard
-        cv::flip(_postcard, _postcard, 1); // y axis
-        save_current_postcard();
-      }
-      else if (c == 'h' && !_postcard.empty()) { // flip postcard
-        cv::flip(_postcard, _postcard, 0); // x axis
-        save_current_postcard();
-      }
-      else if (c == 27 || c == 'q') {
-        quit();
-        break;
-      }
-    } //end while (true)
+    while(!_quit) {
+      poll_watched_folder();
+      upgrade_to_full_resolution(false);
+      // the window keeps its last image: only send it again when it changed
+      if (render_pending())
+        cv::imshow(MAIN_WINDOW_NAME, _final_window);
+      int key = cv::waitKey(FRAME_PERIOD_MS);
+      if (key != -1)
+        record_input_event(InputEvent::key_event(InputEvent::now_ms(), key));
+      handle_key(key);
+    } //end while (!_quit)
   } // end run()
 
   //////////////////////////////////////////////////////////////////////////////
 
+  /*!
+   * Record the key and mouse events received by run(),
+   * they are written in \a filename by quit(), cf input_events.h
+   */
+  inline void record_input_events(const std::string & filename) {
+    _events_filename = filename;
+    _recorded_events.clear();
+    _record_start_ms = InputEvent::now_ms();
+  }
+
+  /*!
+   * Replay recorded events without window, through the same handlers as run(),
+   * at the pace of the recording so that the background decoding has the same time.
+   * Each event is rendered on its own, the frames of run() gathering
+   * the events of FRAME_PERIOD_MS. quit() is called at the end.
+   * The postcards are extracted but neither written nor added to the sidecars,
+   * so that measuring leaves the scans and their postcards untouched.
+   * \param latencies_ms
+   *    for each event, the time from its handling to the end of the rendering
+   *    of _final_window
+   */
+  inline void replay_input_events(const std::vector<InputEvent> & events,
+                                  std::vector<double> & latencies_ms) {
+    latencies_ms.clear();
+    _replaying = true; // until quit(), that saves the pending postcard
+    double start_ms = InputEvent::now_ms();
+    for (unsigned int i = 0; i < events.size() && !_quit; ++i) {
+      double wait_ms = events[i].time_ms - (InputEvent::now_ms() - start_ms);
+      if (wait_ms > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds((long) (1000 * wait_ms)));
+      double t0 = InputEvent::now_ms();
+      if (events[i].type == InputEvent::KEY)
+        handle_key(events[i].key);
+      else
+        handle_mouse(events[i].mouse_event, events[i].x, events[i].y);
+      poll_watched_folder();
+      upgrade_to_full_resolution(false);
+      render_pending();
+      latencies_ms.push_back(InputEvent::now_ms() - t0);
+    } // end for i
+    quit();
+  } // end replay_input_events()
+
+  //////////////////////////////////////////////////////////////////////////////
+
 protected:
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! \param key as returned by cv::waitKey(), -1 if none
+  inline void handle_key(int key) {
+    char c = key;
+    int i = (int) c;
+    //DEBUG_PRINT("c:%c = %i\n", c, i);
+
+    if (c == 'p' || c == 8) // || c == 81 || i == 85) // 81:left | 85:PageUp | 8:backspace
+      goto_prev_playlist_image();
+    else if (c == 'n' || c == ' ') // || c == 83 || i == 86) // 83:right | 86:PageDown
+      goto_next_playlist_image();
+
+    else if (i == 81) { // left
+      _last_mouse_x -= .5;
+      request_zoom_and_redraw();
+    }
+    else if (i == 83) { // right
+      _last_mouse_x += .5;
+      request_zoom_and_redraw();
+    }
+    else if (i == 82) { // up
+      _last_mouse_y -= .5;
+      request_zoom_and_redraw();
+    }
+    else if (i == 84) { // down
+      _last_mouse_y += .5;
+      request_zoom_and_redraw();
+    }
+    else if (c == '+' || i == -85) { // -85:'+' keypad
+      _zoom_level = cv::max(_zoom_level - 1, 1.);
+      request_zoom_and_redraw();
+    }
+    else if (c == '-' || i == -83) { // -83:'-' keypad
+      ++_zoom_level;
+      request_zoom_and_redraw();
+    }
+    else if (i == 10 || i == -115) { // return | keypad return
+      add_corner(_last_mouse_x, _last_mouse_y);
+    }
+    else if (c == 'r' && _postcard_pending) // rotate postcard 90°
+      orient_current_postcard(PostcardOrientation::rotate_left());
+    else if ((c == 'f'|| c=='v') && _postcard_pending) // flip postcard, y axis
+      orient_current_postcard(PostcardOrientation::flip_left_right());
+    else if (c == 'h' && _postcard_pending) // flip postcard, x axis
+      orient_current_postcard(PostcardOrientation::flip_top_bottom());
+    else if (c == 's')
+      set_corner_snapping(!_snap_to_corners);
+    else if (c == 27 || c == 'q')
+      quit();
+  } // end handle_key()
+
+  //////////////////////////////////////////////////////////////////////////////
+
   static void win_cb(int event, int x, int y, int flags, void* cookie) {
     // DEBUG_PRINT("win_cb(%i, %i): event:%i, flag:%i\n", x, y, event, flags);
     PostcardScanExtractor* this_cb = ((PostcardScanExtractor*) cookie);
+    this_cb->record_input_event(InputEvent::mouse(InputEvent::now_ms(), event, x, y, flags));
+    this_cb->handle_mouse(event, x, y);
+  } // end win_cb();
+
+  inline void handle_mouse(int event, int x, int y) {
     if (event == CV_EVENT_LBUTTONDOWN) // do not move mouse if left click
-      this_cb->add_corner(this_cb->_last_mouse_x, this_cb->_last_mouse_y);
+      add_corner(_last_mouse_x, _last_mouse_y);
     else {
-      if (this_cb->_gui_corners.size() == 2) { // only allow perpendicular third point
-        double x1 = this_cb->_gui_corners.front().x, y1 = this_cb->_gui_corners.front().y;
-        double x2 = this_cb->_gui_corners.back().x, y2 = this_cb->_gui_corners.back().y;
+      if (_gui_corners.size() == 2) { // only allow perpendicular third point
+        double x1 = _gui_corners.front().x, y1 = _gui_corners.front().y;
+        double x2 = _gui_corners.back().x, y2 = _gui_corners.back().y;
         double a = x2 - x1, b = y2 - y1;
         cv::Mat A = (cv::Mat_<double>(4,4)
                      << b, 0, 1, 0,
@@ -258,65 +472,147 @@ protected:
         x = AlphaBetaX3Y3.at<double>(2);
         y = AlphaBetaX3Y3.at<double>(3);
       }
-      this_cb->_last_mouse_x = x;
-      this_cb->_last_mouse_y = y;
+      _last_mouse_x = x;
+      _last_mouse_y = y;
     }
     if (event == CV_EVENT_RBUTTONDOWN) { // clear on right button
-      this_cb->_gui_corners.clear();
-      this_cb->_hires_corners.clear();
+      _gui_corners.clear();
+      _hires_corners.clear();
+      _corners_dirty = true;
     }
-    this_cb->recompute_zoom_and_redraw();
-  } // end win_cb();
+    // only the last position will be rendered, at the end of the frame
+    request_zoom_and_redraw();
+  } // end handle_mouse();
+
+  //! keep an event if record_input_events() was called
+  inline void record_input_event(const InputEvent & event) {
+    if (_events_filename.empty())
+      return;
+    _recorded_events.push_back(event);
+    _recorded_events.back().time_ms -= _record_start_ms;
+  }
 
   //////////////////////////////////////////////////////////////////////////////
 
   inline void add_corner(int x, int y) {
     DEBUG_PRINT("adding corner(%i, %i)\n", x, y);
+    if (_playlist.empty()) // waiting for the first scan of the watched folder
+      return;
+    _corners_dirty = true;
     if (_gui_corners.size() >= 3) { // clear corners if new postcard
       _gui_corners.clear();
       _hires_corners.clear();
-      ++_postcard_idx; // must be after save_current_postcard()
+    }
+    cv::Point2f hires_corner((1. * x - MARGIN_SIZE) / _big2small_factor,
+                             (1. * y - MARGIN_SIZE) / _big2small_factor);
+    if (_snap_to_corners) {
+      if (_zoom_needed) // the zoom of the cursor was not rendered yet
+        recompute_zoom_and_redraw();
+      if (_snapped) {
+        hires_corner = _snapped_corner;
+        cv::Point2f side = (_hires_corners.size() == 2 ? _hires_corners[1] - _hires_corners[0]
+                                                      : cv::Point2f());
+        double side_length = dist_L2(side, cv::Point2f());
+        if (side_length > 0) { // third corner: keep the right angle, cf handle_mouse()
+          cv::Point2f normal = cv::Point2f(-side.y, side.x) * (1. / side_length);
+          hires_corner = _hires_corners[1] + normal * normal.dot(hires_corner - _hires_corners[1]);
+        }
+        x = cvRound(hires_corner.x * _big2small_factor + MARGIN_SIZE);
+        y = cvRound(hires_corner.y * _big2small_factor + MARGIN_SIZE);
+      }
     }
     _gui_corners.push_back(cv::Point(x, y));
-    _hires_corners.push_back(cv::Point2f((1. * x - MARGIN_SIZE) / _big2small_factor,
-                                         (1. * y - MARGIN_SIZE) / _big2small_factor));
+    _hires_corners.push_back(hires_corner);
     if (_gui_corners.size() < 3) { // do nothing if corners not over
-      redraw_final_window();
+      request_redraw();
       return;
     }
     // add fourth corner
     _gui_corners.push_back(_gui_corners[0] + _gui_corners[2] - _gui_corners[1]);
-    // compute postcard
-    double w = dist_L2(_hires_corners[0], _hires_corners[1]);
-    double h = dist_L2(_hires_corners[1], _hires_corners[2]);
-    cv::Point2f src [3]= { _hires_corners[0], _hires_corners[1], _hires_corners[2]};
-    cv::Point2f dst [3]= { cv::Point2f(0, 0), cv::Point2f(w, 0), cv::Point2f(w, h)};
-    cv::Mat transform = cv::getAffineTransform(src, dst);
-    _postcard.create(h, w);
-    _postcard.setTo(cv::Scalar::all(0));
-    cv::warpAffine(_scan_img_hires, _postcard, transform,  _postcard.size());
-    save_current_postcard(); // also refresh thumbnail
+    // the previous postcard cannot be oriented anymore
+    save_current_postcard();
+    // the full resolution postcard is only computed when saved
+    std::copy(_hires_corners.begin(), _hires_corners.end(), _postcard_corners);
+    _postcard_orientation = PostcardOrientation();
+    _postcard_pending = extract_postcard_preview(_scan_pyramid, _postcard_corners,
+                                                 ZOOM_WINDOW_SIZE,
+                                                 _postcard_thumbnail_raw);
+    refresh_postcard_thumbnail();
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! display a scan, possibly from a reduced decode, cf ScanPrefetcher::get_preview()
   inline virtual bool load_playlist_image(const std::string & filename) {
     DEBUG_PRINT("load_playlist_image('%s')\n", filename.c_str());
-    cv::Mat3b scan_img = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
-    if (scan_img.empty()) {
-      printf("Could not read file '%s'!\n", filename.c_str());
+    PreparedScan scan;
+    if (!_prefetcher.get_preview(filename, scan) || !set_prepared_scan(scan))
       return false;
-    }
-    return set_image(scan_img);
+    // keep the postcards of the previous sessions, the new ones are numbered after them
+    if (has_annotations(filename))
+      load_annotations(filename, _annotations);
+    for (unsigned int i = 0; i < _annotations.size(); ++i)
+      _postcard_idx = std::max(_postcard_idx, _annotations[i].idx + 1);
+    // nor overwrite the postcards saved without sidecar
+    while (file_readable(get_current_postcard_filename()))
+      ++_postcard_idx;
+    return true;
   }
+
+  /*!
+   * Replace the reduced scan by its full resolution, keeping the corners.
+   * \param wait
+   *    if false, only upgrade if the full resolution is already decoded
+   * \return true if the scan is at full resolution
+   */
+  inline bool upgrade_to_full_resolution(bool wait) {
+    if (_scan_full_resolution)
+      return true;
+    PreparedScan scan;
+    bool ok = (wait ? _prefetcher.get(get_current_filename(), scan)
+                    : _prefetcher.get_if_ready(get_current_filename(), scan));
+    if (!ok)
+      return false;
+    DEBUG_PRINT("upgrade_to_full_resolution('%s')\n", get_current_filename().c_str());
+    // same preview size, cf prepare_lores()
+    _scan_pyramid = scan.pyramid;
+    _scan_img_lores = scan.lores;
+    _scan_full_resolution = true;
+    _corners_dirty = true;
+    request_zoom_and_redraw();
+    return true;
+  } // end upgrade_to_full_resolution()
+  /*!
+   * Append the new scans of the watched folder to the playlist
+   * and decode them in the background, so that they are ready when shown.
+   * The first one is shown if the playlist was empty.
+   */
+  inline void poll_watched_folder() {
+    std::vector<std::string> new_scans;
+    if (!_watcher.poll(new_scans))
+      return;
+    bool was_empty = _playlist.empty();
+    std::vector<std::string> added_scans;
+    for (unsigned int i = 0; i < new_scans.size(); ++i) {
+      if (!_playlist_paths.insert(HotFolderWatcher::canonical_path(new_scans[i])).second)
+        continue;
+      printf("New scan '%s'\n", new_scans[i].c_str());
+      _playlist.push_back(new_scans[i]);
+      added_scans.push_back(new_scans[i]);
+    }
+    if (added_scans.empty())
+      return;
+    if (was_empty)
+      goto_playlist_image(0);
+    _prefetcher.prefetch_later(added_scans);
+  } // end poll_watched_folder()
+
   inline std::string get_current_filename() const {
     return _playlist[_playlist_idx];
   }
   inline std::string get_current_postcard_filename() const {
-    std::ostringstream ans;
-    ans << remove_filename_extension(get_current_filename())
-        << _postcard_suffix << _postcard_idx << ".png";
-    return ans.str();
+    return postcard_filename(get_current_filename(), _postcard_suffix, _postcard_idx,
+                             _encoder.extension());
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -328,91 +624,158 @@ protected:
       printf("Cannot set an empty contour image!\n");
       return false;
     }
-    // rotate 90° if needed
-    if (scan_img_hires.cols < scan_img_hires.rows) {
-      cv::transpose(scan_img_hires, _scan_img_hires);
-      cv::flip(_scan_img_hires, _scan_img_hires, 0);
-    }
-    else { // no rotation
-      scan_img_hires.copyTo(_scan_img_hires);
-    }
-    // resize
-    _big2small_factor = cv::min(1. * WINDOW_WIDTH / _scan_img_hires.cols,
-                                1. * WINDOW_HEIGHT / _scan_img_hires.rows);
-    cv::resize(_scan_img_hires, _scan_img_lores, cv::Size(), _big2small_factor, _big2small_factor);
+    PreparedScan scan;
+    if (!prepare_scan(scan_img_hires, WINDOW_WIDTH, WINDOW_HEIGHT,
+                      ZOOM_WINDOW_SIZE, scan))
+      return false;
+    return set_prepared_scan(scan);
+  } // end set_image()
+
+  //! display a scan already rotated and resized by prepare_scan()
+  bool set_prepared_scan(const PreparedScan & scan) {
+    DEBUG_PRINT("set_prepared_scan(lores:%ix%i, full resolution:%i)\n",
+                scan.lores.cols, scan.lores.rows, scan.full_resolution);
+    // the pixels are shared with the prefetcher cache, they are never modified
+    _scan_img_lores = scan.lores;
+    _scan_pyramid = scan.pyramid;
+    _scan_full_resolution = scan.full_resolution;
+    _big2small_factor = scan.big2small_factor;
     // prepair _final_window
     unsigned int scan_margin_cols = _scan_img_lores.cols + 2 * MARGIN_SIZE;
     unsigned int cols = scan_margin_cols + ZOOM_WINDOW_SIZE;
     unsigned int rows = std::max(_scan_img_lores.rows + 2 * MARGIN_SIZE,
                                  2 * ZOOM_WINDOW_SIZE + MARGIN_SIZE); // zoom + postcard thumbnail
-    _final_window.create(rows, cols);
+    // views of buffers that only grow, so that the next scans allocate nothing
+    _final_window = grow_buffer(_final_window_buffer, rows, cols);
     _final_window.setTo(cv::Scalar::all(100));
     cv::Rect zoom_roi(scan_margin_cols, 0, ZOOM_WINDOW_SIZE, ZOOM_WINDOW_SIZE);
     _final_zoom_img = _final_window(zoom_roi);
     cv::Rect scan_roi(MARGIN_SIZE, MARGIN_SIZE, _scan_img_lores.cols, _scan_img_lores.rows);
     _final_scan_img = _final_window(scan_roi);
+    // the scan pane without the cursor, used for restoring the damaged pixels
+    cv::Rect scan_pane_roi(0, 0, scan_margin_cols, rows);
+    _final_scan_pane = _final_window(scan_pane_roi);
+    _scan_pane_layer = grow_buffer(_scan_pane_layer_buffer, rows, scan_margin_cols);
+    _scan_pane_layer_scan = _scan_pane_layer(scan_roi);
+    _drawn_cross_x = _drawn_cross_y = -1;
+    _corners_dirty = _thumbnail_dirty = true;
     // clear data
     _postcard_idx = 0;
+    _annotations.clear();
     _gui_corners.clear();
     _hires_corners.clear();
-    _postcard.release();
+    _postcard_pending = false;
     _postcard_thumbnail.release();
     recompute_zoom_and_redraw();
     return true;
-  } // end set_image()
+  } // end set_prepared_scan()
 
   //////////////////////////////////////////////////////////////////////////////
 
+  /*!
+   * Write the pending postcards and stop the workers.
+   * run() returns at the end of the current frame.
+   */
   inline void quit() {
+    if (_quit)
+      return;
+    _quit = true;
     printf("The application will shut down now. Have a nice day.\n");
-    exit(0);
+    save_current_postcard();
+    _prefetcher.stop();
+    if (!_writer.flush())
+      printf("Some postcards could not be written!\n");
+    _writer.stop();
+    if (!_events_filename.empty())
+      save_input_events(_events_filename, _playlist, _recorded_events);
+    StageProfiler::instance().dump();
+    if (StageProfiler::instance().enabled()) // cf BufferPool
+      printf("Large buffer allocations: %i\n", (int) BufferPool::allocations());
   } // end quit()
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! ask for a redraw at the end of the current frame
+  inline void request_redraw() { _redraw_needed = true; }
+  //! ask for a new zoom and a redraw at the end of the current frame
+  inline void request_zoom_and_redraw() { _zoom_needed = _redraw_needed = true; }
+
+  /*!
+   * Render once all the changes requested during the frame.
+   * \return true if _final_window was redrawn since the previous call,
+   *    by this call or directly, for instance by set_prepared_scan()
+   */
+  inline bool render_pending() {
+    if (_zoom_needed)
+      recompute_zoom_and_redraw();
+    else if (_redraw_needed)
+      redraw_final_window();
+    bool changed = _window_changed;
+    _window_changed = false;
+    return changed;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Repaint the parts of _final_window that changed since the last call:
+   * the scan pane is only fully repainted when the corners changed,
+   * otherwise only the rows and columns of the previous cross are restored.
+   */
   void redraw_final_window() {
     DEBUG_PRINT("redraw_final_window(%g,%g)\n", _last_mouse_x, _last_mouse_y);
-    // copy scan
-    _scan_img_lores.copyTo(_final_scan_img);
-    // draw main window cross
-    draw_bicolor_cross(_final_scan_img, _last_mouse_x-MARGIN_SIZE,
-                       _last_mouse_y-MARGIN_SIZE, _cross_color1, _cross_color2);
-    // draw postcard corners
-    unsigned int ncorners = _gui_corners.size();
-    for(unsigned int i = 0; i < ncorners; ++i) {
-      cv::circle(_final_window, _gui_corners[i], 3, CV_RGB(0, 0, 255), 2);
-      if (i < ncorners - 1 || ncorners == 4)
-        cv::line(_final_window, _gui_corners[i],  _gui_corners[(i+1)%4],
-            CV_RGB(0, 0, 255), 1);
+    ScopedStageTimer timer(StageProfiler::REDRAW);
+    _redraw_needed = false;
+    _window_changed = true;
+    if (_corners_dirty) {
+      // rebuild the layer made of the scan and the postcard corners
+      _scan_pane_layer.setTo(cv::Scalar::all(100));
+      _scan_img_lores.copyTo(_scan_pane_layer_scan);
+      unsigned int ncorners = _gui_corners.size();
+      for(unsigned int i = 0; i < ncorners; ++i) {
+        cv::circle(_scan_pane_layer, _gui_corners[i], 3, CV_RGB(0, 0, 255), 2);
+        if (i < ncorners - 1 || ncorners == 4)
+          cv::line(_scan_pane_layer, _gui_corners[i],  _gui_corners[(i+1)%4],
+              CV_RGB(0, 0, 255), 1);
+      }
+      _scan_pane_layer.copyTo(_final_scan_pane);
+      _corners_dirty = false;
+    }
+    else { // erase the previous cross
+      if (_drawn_cross_y >= 0 && _drawn_cross_y < _final_scan_img.rows) {
+        cv::Mat3b final_row = _final_scan_img.row(_drawn_cross_y);
+        _scan_pane_layer_scan.row(_drawn_cross_y).copyTo(final_row);
+      }
+      if (_drawn_cross_x >= 0 && _drawn_cross_x < _final_scan_img.cols) {
+        cv::Mat3b final_col = _final_scan_img.col(_drawn_cross_x);
+        _scan_pane_layer_scan.col(_drawn_cross_x).copyTo(final_col);
+      }
     }
+    // draw main window cross
+    _drawn_cross_x = cvFloor(_last_mouse_x - MARGIN_SIZE);
+    _drawn_cross_y = cvFloor(_last_mouse_y - MARGIN_SIZE);
+    _scan_cross.draw(_final_scan_img, _drawn_cross_x, _drawn_cross_y);
     // redraw_zoom_window
-    _zoom_img.copyTo(_final_zoom_img);
-    // draw zoom cross
-    draw_bicolor_cross(_final_zoom_img, ZOOM_WINDOW_SIZE/2,ZOOM_WINDOW_SIZE/2,
-                       _cross_color1, _cross_color2);
-    // draw postcard thumbnail
-    if (_postcard_thumbnail.empty())
-      return;
-    _postcard_thumbnail.copyTo(_final_postcard_img);
-  } // end redraw_final_window();
-
-  //////////////////////////////////////////////////////////////////////////////
-
-  static const inline void draw_bicolor_cross(cv::Mat3b & img,
-                                              const unsigned int x,  const unsigned int y,
-                                              cv::Scalar color1, cv::Scalar color2,
-                                              unsigned int thickness = 1) {
-    static const unsigned int step = 10;
-    unsigned int ncols = img.cols, nrows = img.rows;
-    for(unsigned int col = 0; col < ncols; col+=step) {
-      cv::line(img, cv::Point(col, y), cv::Point(col + step, y), color1, thickness);
-      std::swap(color1, color2);
+    if (_zoom_changed) {
+      _zoom_img.copyTo(_final_zoom_img);
+      _zoom_cross.draw(_final_zoom_img, ZOOM_WINDOW_SIZE/2, ZOOM_WINDOW_SIZE/2);
+      if (_snapped)
+        cv::circle(_final_zoom_img, cv::Point(cvRound(_snapped_zoom_corner.x),
+                                              cvRound(_snapped_zoom_corner.y)),
+                   4, CV_RGB(0, 255, 0), 1);
+      _zoom_changed = false;
     }
-    for(unsigned int row = 0; row < nrows; row+=step) {
-      cv::line(img, cv::Point(x, row), cv::Point(x, row + step), color1, thickness);
-      std::swap(color1, color2);
+    // draw postcard thumbnail
+    if (_thumbnail_dirty) {
+      unsigned int scan_margin_cols = _scan_img_lores.cols + 2 * MARGIN_SIZE;
+      cv::Rect thumb_area(scan_margin_cols, ZOOM_WINDOW_SIZE + MARGIN_SIZE,
+                          ZOOM_WINDOW_SIZE, ZOOM_WINDOW_SIZE);
+      _final_window(thumb_area).setTo(cv::Scalar::all(100));
+      if (!_postcard_thumbnail.empty())
+        _postcard_thumbnail.copyTo(_final_postcard_img);
+      _thumbnail_dirty = false;
     }
-  } // end draw_bicolor_cross();
+  } // end redraw_final_window();
 
   //////////////////////////////////////////////////////////////////////////////
 
@@ -421,61 +784,179 @@ protected:
         y_hires = (_last_mouse_y - MARGIN_SIZE) / _big2small_factor;
     //DEBUG_PRINT("(%g,%g) ->redraw zoom at (%i,%i)\n", _last_mouse_x, _last_mouse_y, x_hires, y_hires);
     double zoom_size = _zoom_level / _big2small_factor;
-    cv::Point2f src [3]= { cv::Point2f(x_hires - zoom_size, y_hires - zoom_size),
-                           cv::Point2f(x_hires + zoom_size, y_hires - zoom_size),
-                           cv::Point2f(x_hires + zoom_size, y_hires + zoom_size)};
-    cv::Point2f dst [3]= { cv::Point2f(0, 0),
-                           cv::Point2f(ZOOM_WINDOW_SIZE, 0),
-                           cv::Point2f(ZOOM_WINDOW_SIZE, ZOOM_WINDOW_SIZE)};
-    cv::Mat transform = cv::getAffineTransform(src, dst);
-    cv::warpAffine(_scan_img_hires, _zoom_img, transform,  _zoom_img.size());
+    // only warp the needed part of the closest pyramid level
+    {
+      ScopedStageTimer timer(StageProfiler::ZOOM_WARP);
+      warp_square_from_pyramid(_scan_pyramid, x_hires, y_hires, zoom_size, _zoom_img);
+    }
+    // the corner is searched in the pixels just warped, at the zoom resolution
+    _snapped = false;
+    if (_snap_to_corners) {
+      ScopedStageTimer timer(StageProfiler::CORNER_SNAP);
+      _snapped = _snapper.snap(_zoom_img, _snapped_zoom_corner);
+      // back to level 0, cf warp_square_from_pyramid()
+      double zoom2hires = 2 * zoom_size / ZOOM_WINDOW_SIZE;
+      _snapped_corner = cv::Point2f(x_hires - zoom_size + zoom2hires * _snapped_zoom_corner.x,
+                                    y_hires - zoom_size + zoom2hires * _snapped_zoom_corner.y);
+    }
+    _zoom_needed = false;
+    _zoom_changed = true;
     redraw_final_window();
     return true;
   } // end recompute_zoom_and_redraw()
 
   //////////////////////////////////////////////////////////////////////////////
 
-  inline bool save_current_postcard() {
-    DEBUG_PRINT("save_current_postcard('%s')\n", get_current_postcard_filename().c_str());
-    if (_postcard.empty())
-      return false;
-    // recompute postcard thumbnail
-    double ps2thumb_factor = cv::min(1. * ZOOM_WINDOW_SIZE / _postcard.cols,
-                                     1. * ZOOM_WINDOW_SIZE / _postcard.rows);
-    cv::resize(_postcard, _postcard_thumbnail, cv::Size(),
-               ps2thumb_factor, ps2thumb_factor);
+  //! compose the orientation of the current postcard, only the thumbnail is updated
+  inline void orient_current_postcard(const PostcardOrientation & orientation) {
+    _postcard_orientation = _postcard_orientation.then(orientation);
+    refresh_postcard_thumbnail();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline void refresh_postcard_thumbnail() {
+    if (!_postcard_pending)
+      _postcard_thumbnail.release();
+    else
+      _postcard_orientation.orient_image(_postcard_thumbnail_raw, _postcard_thumbnail);
     unsigned int scan_margin_cols = _scan_img_lores.cols + 2 * MARGIN_SIZE;
     cv::Rect _postcard_roi (scan_margin_cols, ZOOM_WINDOW_SIZE + MARGIN_SIZE,
                             _postcard_thumbnail.cols,  _postcard_thumbnail.rows);
     _final_postcard_img = _final_window(_postcard_roi);
-    redraw_final_window(); // refresh thumb
+    _thumbnail_dirty = true;
+    request_redraw(); // refresh thumb
+  } // end refresh_postcard_thumbnail()
+
+  //////////////////////////////////////////////////////////////////////////////
 
-    // save postcard
-    if (!cv::imwrite(get_current_postcard_filename(), _postcard)) {
-      printf("Could not write '%s'!\n", get_current_postcard_filename().c_str());
+  /*!
+   * Extract the current postcard in its final orientation, with a single warp,
+   * and write it in the background. The next postcard will get a new index.
+   * Its corners and orientation are added to the sidecar of the scan.
+   * Nothing is written while replaying events, cf replay_input_events().
+   */
+  inline bool save_current_postcard() {
+    if (!_postcard_pending)
       return false;
+    DEBUG_PRINT("save_current_postcard('%s')\n", get_current_postcard_filename().c_str());
+    _postcard_pending = false;
+    if (!upgrade_to_full_resolution(true)) {
+      printf("Could not extract '%s'!\n", get_current_postcard_filename().c_str());
+      return false;
+    }
+    cv::Point2f oriented_corners[3];
+    _postcard_orientation.orient_corners(_postcard_corners, oriented_corners);
+    // a new buffer of the pool, the previous one may still be used by the writer.
+    // It goes back to the pool once written.
+    _postcard.release();
+    cv::Size size = postcard_size(oriented_corners);
+    _postcard = _buffers.acquire3b(size.height, size.width);
+    bool ok;
+    {
+      ScopedStageTimer timer(StageProfiler::EXTRACTION_WARP);
+      ok = extract_postcard(*_scan_pyramid.front(), oriented_corners, _postcard,
+                            &_buffers);
     }
-    printf("Succesfully written '%s'\n", get_current_postcard_filename().c_str());
+    if (!ok) {
+      printf("Could not extract '%s'!\n", get_current_postcard_filename().c_str());
+      return false;
+    }
+    if (!_replaying) {
+      _writer.write(get_current_postcard_filename(), _postcard);
+      write_postcard_variants();
+    }
+    PostcardAnnotation annotation;
+    annotation.idx = _postcard_idx;
+    for (unsigned int i = 0; i < 3; ++i)
+      annotation.corners[i] = _scan_pyramid.front()->stored_point(_postcard_corners[i]);
+    annotation.orientation = _postcard_orientation;
+    set_annotation(_annotations, annotation);
+    if (!_replaying)
+      save_annotations(get_current_filename(), _annotations);
+    ++_postcard_idx;
     return true;
   } // end save_current_postcard()
 
+  /*!
+   * Queue the variants of the postcard that was just saved, from the pixels
+   * in memory: the writer shrinks and encodes them in parallel.
+   * The small variants are shrunk from the thumbnail shown in the window,
+   * that was already computed from a small level of the pyramid.
+   */
+  inline void write_postcard_variants() {
+    if (_variants.empty())
+      return;
+    std::string filename = get_current_postcard_filename();
+    cv::Mat3b thumbnail; // a copy, the one of the window is overwritten by the next postcard
+    if (_postcard_thumbnail.cols <= _postcard.cols && _postcard_thumbnail.rows <= _postcard.rows)
+      thumbnail = _postcard_thumbnail.clone();
+    for (unsigned int i = 0; i < _variants.size(); ++i) {
+      const PostcardVariant & variant = _variants[i];
+      bool from_thumbnail = (!thumbnail.empty() && variant.max_size
+                             <= (unsigned int) std::max(thumbnail.cols, thumbnail.rows));
+      _writer.write(variant.filename(filename), (from_thumbnail ? thumbnail : _postcard),
+                    variant.encoder, variant.max_size);
+    }
+  } // end write_postcard_variants()
+
+  //! \return the top-left corner of \a buffer, that is enlarged if needed
+  static cv::Mat3b grow_buffer(cv::Mat3b & buffer, int rows, int cols) {
+    if (buffer.rows < rows || buffer.cols < cols) {
+      buffer.create(std::max(buffer.rows, rows), std::max(buffer.cols, cols));
+      BufferPool::count_allocation();
+    }
+    return buffer(cv::Rect(0, 0, cols, rows));
+  }
+
   //////////////////////////////////////////////////////////////////////////////
 
   // GUI
   std::string MAIN_WINDOW_NAME;
   double _last_mouse_x, _last_mouse_y, _big2small_factor, _zoom_level;
-  cv::Mat3b _scan_img_hires, _scan_img_lores, _zoom_img, _final_window, _postcard;
+  cv::Mat3b _scan_img_lores, _zoom_img, _final_window, _postcard;
   cv::Scalar _cross_color1, _cross_color2;
   cv::Mat3b _final_zoom_img, _final_postcard_img, _final_scan_img;
+  TiledPyramid _scan_pyramid; // level 0 is the full resolution
+  bool _scan_full_resolution; // false while only a reduced decode is available
+  // compositing
+  BicolorCross _scan_cross, _zoom_cross;
+  cv::Mat3b _final_scan_pane, _scan_pane_layer, _scan_pane_layer_scan;
+  cv::Mat3b _final_window_buffer, _scan_pane_layer_buffer; // cf grow_buffer()
+  int _drawn_cross_x, _drawn_cross_y;
+  bool _zoom_needed, _redraw_needed, _zoom_changed;
+  bool _window_changed; // redrawn since the last call to render_pending()
+  bool _corners_dirty, _thumbnail_dirty;
+  // corner snapping, cf set_corner_snapping()
+  CornerSnapper _snapper;
+  bool _snap_to_corners, _snapped;
+  cv::Point2f _snapped_zoom_corner, _snapped_corner; // in the zoom window, in level 0
   // postcard
-  cv::Mat3b _postcard_buffer, _postcard_thumbnail;
+  cv::Mat3b _postcard_thumbnail_raw, _postcard_thumbnail;
+  bool _postcard_pending; // corners set but not written yet
+  cv::Point2f _postcard_corners[3];
+  PostcardOrientation _postcard_orientation;
   std::string _postcard_suffix;
+  EncoderProfile _encoder;
+  std::vector<PostcardVariant> _variants;
   std::vector<cv::Point> _gui_corners;
   std::vector<cv::Point2f> _hires_corners;
   unsigned int _postcard_idx;
+  std::vector<PostcardAnnotation> _annotations; // the saved postcards of the scan
   // playlist
   std::vector<std::string> _playlist;
+  std::set<std::string> _playlist_paths; // cf HotFolderWatcher::canonical_path()
   unsigned int _playlist_idx;
+  ScanPrefetcher _prefetcher;
+  BufferPool _buffers; // the postcards and the regions of the scan they are extracted from
+  HotFolderWatcher _watcher;
+  PostcardWriter _writer;
+  // input events, cf record_input_events()
+  std::string _events_filename;
+  std::vector<InputEvent> _recorded_events;
+  double _record_start_ms;
+  bool _replaying; // nothing is written, cf replay_input_events()
+  bool _quit;
 }; // en class PostcardScanExtractor
 
 #endif // postcard_scan_extractor_H
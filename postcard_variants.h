@@ -0,0 +1,88 @@
+/*!
+  \file        postcard_variants.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+The derivatives of each postcard, written next to it at a smaller size
+and possibly in another format, for instance for the web and for thumbnails.
+A variant is written as "SUFFIX:MAX_SIZE[:PROFILE]", for instance
+"_web:1600:jpeg:85" writes "scan_postcard0_web.jpg" next to "scan_postcard0.png",
+its sides being at most 1600 pixels, cf EncoderProfile for PROFILE.
+ */
+
+#ifndef POSTCARD_VARIANTS_H
+#define POSTCARD_VARIANTS_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include "encoder_profile.h"
+#include "postcard_extraction.h"
+
+/*!
+ * Shrink an image so that its sides are at most \a max_size, with cv::INTER_AREA.
+ * \return \a img itself if it is small enough or if \a max_size is 0
+ */
+inline cv::Mat shrink_image(const cv::Mat & img, unsigned int max_size) {
+  double factor = 1. * max_size / std::max(img.cols, img.rows);
+  if (max_size == 0 || factor >= 1)
+    return img;
+  cv::Mat ans;
+  cv::resize(img, ans, cv::Size(), factor, factor, cv::INTER_AREA);
+  return ans;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct PostcardVariant {
+  PostcardVariant() : max_size(0) {}
+
+  /*!
+   * Read a variant, cf the syntax at the top of this file.
+   * \return false if it is not valid
+   */
+  bool parse(const std::string & spec) {
+    size_t colon1 = spec.find(':');
+    size_t colon2 = (colon1 == std::string::npos ? colon1 : spec.find(':', colon1 + 1));
+    std::string size_str = (colon1 == std::string::npos ? ""
+                            : spec.substr(colon1 + 1, colon2 - colon1 - 1)); // npos: until the end
+    suffix = spec.substr(0, colon1);
+    max_size = atoi(size_str.c_str());
+    if (suffix.empty() || max_size == 0
+        || size_str.find_first_not_of("0123456789") != std::string::npos) {
+      printf("Invalid postcard variant '%s'!\n", spec.c_str());
+      return false;
+    }
+    encoder = EncoderProfile();
+    return (colon2 == std::string::npos || encoder.parse(spec.substr(colon2 + 1)));
+  } // end parse()
+
+  //! \example ("/foo/scan_postcard2.png") -> "/foo/scan_postcard2_web.jpg"
+  inline std::string filename(const std::string & postcard_filename) const {
+    return remove_filename_extension(postcard_filename) + suffix + encoder.extension();
+  }
+
+  std::string suffix;
+  unsigned int max_size; //!< the bound of the sides of the variant
+  EncoderProfile encoder;
+}; // end struct PostcardVariant
+
+#endif // POSTCARD_VARIANTS_H
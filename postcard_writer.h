@@ -0,0 +1,212 @@
+/*!
+  \file        postcard_writer.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A background queue that encodes and writes the postcards.
+Repeated saves of the same file are coalesced: only the latest is written.
+Several workers encode in parallel, for instance the variants of a postcard
+at several sizes, that they shrink themselves.
+ */
+
+#ifndef POSTCARD_WRITER_H
+#define POSTCARD_WRITER_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "encoder_profile.h"
+#include "postcard_variants.h"
+#include "stage_profiler.h"
+
+class PostcardWriter {
+public:
+  /*!
+   * \param nthreads
+   *    the number of workers, 0 for half of the cores
+   */
+  PostcardWriter(unsigned int nthreads = 0) : _nbusy(0), _stopped(false), _nfailures(0) {
+    if (nthreads == 0)
+      nthreads = std::max(1U, std::thread::hardware_concurrency() / 2);
+    for (unsigned int i = 0; i < nthreads; ++i)
+      _workers.push_back(std::thread(&PostcardWriter::worker_loop, this));
+  }
+
+  ~PostcardWriter() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Queue an image for writing, with the encoder of set_encoder_profile().
+   * If a previous version of \a filename is still queued, it is replaced.
+   * \param img
+   *    the image to write. Its pixels must not be modified afterwards,
+   *    pass a clone if needed.
+   */
+  inline void write(const std::string & filename, const cv::Mat & img) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Job job;
+    job.img = img;
+    job.encoder = _encoder;
+    queue(filename, job, lock);
+  }
+
+  /*!
+   * Queue an image for writing, shrunk by the worker if needed.
+   * \param encoder
+   *    the format, \a filename having its extension
+   * \param max_size
+   *    the bound of the sides of the written image, 0 for no bound.
+   *    The image is never enlarged.
+   */
+  inline void write(const std::string & filename, const cv::Mat & img,
+                    const EncoderProfile & encoder, unsigned int max_size) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Job job;
+    job.img = img;
+    job.encoder = encoder;
+    job.max_size = max_size;
+    queue(filename, job, lock);
+  }
+
+  //! the parameters of the encoder, for the images written from now on
+  inline void set_encoder_profile(const EncoderProfile & encoder) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _encoder = encoder;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Wait until all queued images are written.
+   * \return true if no write failed since the last call to flush()
+   */
+  inline bool flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_order.empty() || _nbusy > 0)
+      _done_cond.wait(lock);
+    bool ok = (_nfailures == 0);
+    _nfailures = 0;
+    return ok;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! write the queued images then stop the worker threads
+  inline void stop() {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopped = true;
+    }
+    _work_cond.notify_all();
+    for (unsigned int i = 0; i < _workers.size(); ++i)
+      if (_workers[i].joinable())
+        _workers[i].join();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  struct Job {
+    Job() : max_size(0) {}
+    cv::Mat img;
+    EncoderProfile encoder;
+    unsigned int max_size;
+  };
+
+  //! add or replace a job. Locked.
+  inline void queue(const std::string & filename, const Job & job,
+                    std::unique_lock<std::mutex> & lock) {
+    std::map<std::string, Job>::iterator it = _queued.find(filename);
+    if (it != _queued.end()) // coalesce with the queued version
+      it->second = job;
+    else {
+      _queued.insert(std::make_pair(filename, job));
+      _order.push_back(filename);
+    }
+    lock.unlock();
+    _work_cond.notify_one();
+  }
+
+  //! \return the oldest queued file that no worker is writing. Locked.
+  inline std::deque<std::string>::iterator next_job() {
+    std::deque<std::string>::iterator it = _order.begin();
+    while (it != _order.end() && _in_progress.count(*it))
+      ++it;
+    return it;
+  }
+
+  void worker_loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      while (!_stopped && next_job() == _order.end())
+        _work_cond.wait(lock);
+      std::deque<std::string>::iterator next = next_job();
+      if (next == _order.end()) // stopped
+        return;
+      std::string filename = *next;
+      _order.erase(next);
+      Job job = _queued[filename];
+      _queued.erase(filename);
+      _in_progress.insert(filename); // a newer version waits for this one
+      ++_nbusy;
+      lock.unlock();
+      bool ok;
+      {
+        ScopedStageTimer timer(StageProfiler::ENCODE_WRITE);
+        ok = job.encoder.write(filename, shrink_image(job.img, job.max_size));
+      }
+      if (ok)
+        printf("Succesfully written '%s'\n", filename.c_str());
+      else
+        printf("Could not write '%s'!\n", filename.c_str());
+      job.img.release(); // outside of the lock
+      lock.lock();
+      if (!ok)
+        ++_nfailures;
+      _in_progress.erase(filename);
+      --_nbusy;
+      _done_cond.notify_all();
+      _work_cond.notify_all(); // a newer version of this file may be waiting
+    } // end while (true)
+  } // end worker_loop()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::map<std::string, Job> _queued;
+  std::deque<std::string> _order; // FIFO of the keys of _queued
+  std::set<std::string> _in_progress; // written by a worker
+  EncoderProfile _encoder;
+  unsigned int _nbusy;
+  bool _stopped;
+  unsigned int _nfailures;
+  std::mutex _mutex;
+  std::condition_variable _work_cond, _done_cond;
+  std::vector<std::thread> _workers;
+}; // end class PostcardWriter
+
+#endif // POSTCARD_WRITER_H
@@ -0,0 +1,329 @@
+/*!
+  \file        scan_disk_cache.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A persistent cache of prepared scans, shared between sessions:
+when a scan is opened again, its preview and pyramid are mapped from the cache
+instead of decoding, rotating and resizing the scan again.
+
+Each entry is a folder named after the key of the scan, a hash of its path,
+size and modification time, so that a modified scan is not served
+from the cache. It contains the pyramid levels and the preview
+as TiledImage files, which are mapped as they are, and a "meta" file
+written last. The least recently used entries are evicted above a size limit.
+ */
+
+#ifndef SCAN_DISK_CACHE_H
+#define SCAN_DISK_CACHE_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "scan_pyramid.h"
+
+// the modification time with nanoseconds, named differently on macOS
+#ifdef __APPLE__
+#define SCAN_DISK_CACHE_MTIM st_mtimespec
+#else // __APPLE__
+#define SCAN_DISK_CACHE_MTIM st_mtim
+#endif // __APPLE__
+
+class ScanDiskCache {
+public:
+  //! the unfinished entries older than this are removed even if their process runs
+  static const int STALE_STAGING_S = 24 * 3600;
+
+  ScanDiskCache() : _max_bytes(0), _total_bytes(0) {}
+
+  //! $XDG_CACHE_HOME/postcard_scan_extractor, or ~/.cache/postcard_scan_extractor
+  static std::string default_dir() {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg)
+      return std::string(xdg) + "/postcard_scan_extractor";
+    const char* home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/postcard_scan_extractor";
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Use a folder as cache, creating it if needed.
+   * The entries left unfinished by a session that died are removed,
+   * the ones of the other running sessions sharing the folder are kept.
+   * \param max_bytes
+   *    the size limit of the cache, 0 disables it
+   * \return true if success
+   */
+  bool enable(const std::string & dir, size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dir.clear();
+    if (max_bytes == 0)
+      return true;
+    // mkdir -p, each prefix ending before a '/' after the first character
+    for (size_t pos = 0; pos != std::string::npos; ) {
+      pos = dir.find('/', pos + 1);
+      mkdir(dir.substr(0, pos).c_str(), 0755);
+    }
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+      printf("Could not open the cache folder '%s': %s\n", dir.c_str(), strerror(errno));
+      return false;
+    }
+    _total_bytes = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+      std::string name(entry->d_name);
+      if (name == "." || name == "..")
+        continue;
+      if (name.find(".tmp") != std::string::npos) {
+        if (is_stale_staging(dir + "/" + name))
+          remove_entry(dir + "/" + name);
+      }
+      else
+        _total_bytes += entry_bytes(dir + "/" + name);
+    }
+    closedir(d);
+    _dir = dir;
+    _max_bytes = max_bytes;
+    evict("");
+    return true;
+  } // end enable()
+
+  inline bool enabled() const { return !_dir.empty(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \return the key of a scan: a hash of its path, size and modification time,
+   * to the nanosecond, or "" if it does not exist.
+   * The content is not read, so that the key costs nothing before the first
+   * decode: a scan rewritten in place always gets a new modification time.
+   */
+  static std::string key(const std::string & filename) {
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0)
+      return "";
+    uint64_t hash = FNV_OFFSET;
+    hash = fnv1a(filename.data(), filename.size(), hash);
+    int64_t identity[3] = { (int64_t) file_stat.st_size,
+                            (int64_t) file_stat.SCAN_DISK_CACHE_MTIM.tv_sec,
+                            (int64_t) file_stat.SCAN_DISK_CACHE_MTIM.tv_nsec };
+    hash = fnv1a(identity, sizeof(identity), hash);
+    char ans[17];
+    snprintf(ans, sizeof(ans), "%016llx", (unsigned long long) hash);
+    return ans;
+  } // end key()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Map a cached scan.
+   * \return true if the entry exists and is valid
+   */
+  bool load(const std::string & key, TiledPyramid & pyramid,
+            cv::Mat3b & lores, double & big2small_factor) {
+    if (!enabled() || key.empty())
+      return false;
+    std::string entry_dir = _dir + "/" + key;
+    FILE* f = fopen((entry_dir + "/meta").c_str(), "r");
+    if (f == NULL)
+      return false;
+    unsigned int nlevels = 0;
+    bool ok = (fscanf(f, "%lf %u", &big2small_factor, &nlevels) == 2 && nlevels > 0);
+    fclose(f);
+    pyramid.clear();
+    for (unsigned int i = 0; ok && i < nlevels; ++i) {
+      TiledImagePtr level(new TiledImage());
+      ok = level->open(pyramid_level_filename(entry_dir, i));
+      pyramid.push_back(level);
+    }
+    TiledImage lores_tiles;
+    ok = ok && lores_tiles.open(entry_dir + "/lores.tiles");
+    if (!ok) {
+      pyramid.clear();
+      return false;
+    }
+    lores_tiles.get_roi(cv::Rect(0, 0, lores_tiles.cols(), lores_tiles.rows()), lores);
+    utimes((entry_dir + "/meta").c_str(), NULL); // recently used
+    return true;
+  } // end load()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Start a new entry.
+   * \return the folder where the pyramid must be written, cf build_pyramid(),
+   *    or "" if the cache is disabled
+   */
+  std::string begin_entry(const std::string & key) {
+    if (!enabled() || key.empty())
+      return "";
+    std::ostringstream path_stream; // the pid tells the other sessions if it is unfinished
+    path_stream << _dir << "/" << key << ".tmp_" << getpid() << "_XXXXXX";
+    std::string path = path_stream.str();
+    std::vector<char> buffer(path.begin(), path.end());
+    buffer.push_back('\0');
+    if (mkdtemp(&(buffer[0])) == NULL)
+      return "";
+    return std::string(&(buffer[0]));
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Finish an entry started with begin_entry() and evict the old entries.
+   * \param success
+   *    if false, the entry is dropped
+   */
+  void commit_entry(const std::string & key, const std::string & staging_dir,
+                    bool success, const cv::Mat3b & lores,
+                    double big2small_factor, unsigned int nlevels) {
+    if (staging_dir.empty())
+      return;
+    TiledImage lores_tiles;
+    FILE* f = NULL;
+    success = success && lores_tiles.create(lores, false, staging_dir + "/lores.tiles")
+        && (f = fopen((staging_dir + "/meta").c_str(), "w")) != NULL;
+    if (f) {
+      fprintf(f, "%.17g %u\n", big2small_factor, nlevels);
+      success = (fclose(f) == 0);
+    }
+    std::string entry_dir = _dir + "/" + key;
+    // an other session may have written the same entry meanwhile
+    if (!success || rename(staging_dir.c_str(), entry_dir.c_str()) != 0) {
+      remove_entry(staging_dir);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _total_bytes += entry_bytes(entry_dir);
+    evict(key);
+  } // end commit_entry()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  static const uint64_t FNV_OFFSET = 14695981039346656037ULL, FNV_PRIME = 1099511628211ULL;
+
+  static inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < size; ++i)
+      hash = (hash ^ bytes[i]) * FNV_PRIME;
+    return hash;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the size of the files of an entry
+  static size_t entry_bytes(const std::string & entry_dir) {
+    size_t ans = 0;
+    DIR* d = opendir(entry_dir.c_str());
+    if (!d)
+      return 0;
+    struct dirent* entry;
+    struct stat file_stat;
+    while ((entry = readdir(d)) != NULL)
+      if (stat((entry_dir + "/" + entry->d_name).c_str(), &file_stat) == 0
+          && S_ISREG(file_stat.st_mode))
+        ans += file_stat.st_size;
+    closedir(d);
+    return ans;
+  }
+
+  /*!
+   * \return true if a staging folder, cf begin_entry(), was left by a process
+   * that does not run anymore, or if it is too old to be still written
+   */
+  static bool is_stale_staging(const std::string & staging_dir) {
+    struct stat dir_stat;
+    if (stat(staging_dir.c_str(), &dir_stat) != 0)
+      return false;
+    if (time(NULL) - dir_stat.st_mtime > STALE_STAGING_S)
+      return true;
+    size_t pos = staging_dir.rfind(".tmp_");
+    int pid = atoi(staging_dir.c_str() + pos + 5); // 0 if written without pid
+    return (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH);
+  }
+
+  //! remove an entry. The scans using it keep their mappings.
+  static void remove_entry(const std::string & entry_dir) {
+    DIR* d = opendir(entry_dir.c_str());
+    if (!d)
+      return;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+      std::string name(entry->d_name);
+      if (name != "." && name != "..")
+        unlink((entry_dir + "/" + name).c_str());
+    }
+    closedir(d);
+    rmdir(entry_dir.c_str());
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! remove the least recently used entries, but \a keep_key, above the limit. Locked.
+  void evict(const std::string & keep_key) {
+    if (_total_bytes <= _max_bytes)
+      return;
+    // (last use, key) of all entries
+    std::vector< std::pair<time_t, std::string> > entries;
+    DIR* d = opendir(_dir.c_str());
+    if (!d)
+      return;
+    struct dirent* entry;
+    struct stat meta_stat;
+    while ((entry = readdir(d)) != NULL) {
+      std::string name(entry->d_name);
+      if (name != "." && name != ".." && name != keep_key
+          && name.find(".tmp") == std::string::npos
+          && stat((_dir + "/" + name + "/meta").c_str(), &meta_stat) == 0)
+        entries.push_back(std::make_pair(meta_stat.st_mtime, name));
+    }
+    closedir(d);
+    std::sort(entries.begin(), entries.end());
+    for (unsigned int i = 0; i < entries.size() && _total_bytes > _max_bytes; ++i) {
+      std::string entry_dir = _dir + "/" + entries[i].second;
+      _total_bytes -= std::min(_total_bytes, entry_bytes(entry_dir));
+      remove_entry(entry_dir);
+    }
+  } // end evict()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::string _dir; // empty if disabled
+  size_t _max_bytes, _total_bytes;
+  std::mutex _mutex;
+}; // end class ScanDiskCache
+
+#endif // SCAN_DISK_CACHE_H
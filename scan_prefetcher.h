@@ -0,0 +1,606 @@
+/*!
+  \file        scan_prefetcher.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A background loader that decodes scans ahead of time
+and keeps the ready-to-display ones in a memory-capped LRU cache.
+
+A scan that is not ready can first be shown from a reduced decode of its JPEG,
+using the DCT scaling of the decoder, which is several times faster
+than decoding the full resolution. The full resolution is then decoded
+in the background.
+ */
+
+#ifndef SCAN_PREFETCHER_H
+#define SCAN_PREFETCHER_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdio.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "scan_disk_cache.h"
+#include "scan_pyramid.h"
+#include "stage_profiler.h"
+
+// the reduced decodes, cv::IMREAD_REDUCED_COLOR_*, appeared in OpenCV 3.2
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2)
+#define SCAN_PREFETCHER_REDUCED_DECODE
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! a scan, rotated to landscape, with its preview for the main window
+struct PreparedScan {
+  PreparedScan() : big2small_factor(1), full_resolution(false) {}
+  //! the tiled mip pyramid of the scan, level 0 is the full resolution
+  TiledPyramid pyramid;
+  cv::Mat3b lores;
+  double big2small_factor;
+  //! false if the first levels of the pyramid are missing, cf prepare_scan_preview()
+  bool full_resolution;
+
+  //! \return the number of bytes used by the pixels of the scan,
+  //! most of them being in the files backing the tiles
+  inline size_t memory_size() const {
+    size_t ans = lores.total() * lores.elemSize();
+    for (unsigned int i = 0; i < pyramid.size(); ++i)
+      if (pyramid[i])
+        ans += pyramid[i]->file_size();
+    return ans;
+  }
+}; // end struct PreparedScan
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! compute the preview of a scan, rotated to landscape, from an image of any resolution
+inline void prepare_lores(const cv::Mat3b & img,
+                          const cv::Size & full_size,
+                          unsigned int lores_max_width,
+                          unsigned int lores_max_height,
+                          PreparedScan & out) {
+  bool rotate = (full_size.width < full_size.height);
+  int landscape_cols = std::max(full_size.width, full_size.height),
+      landscape_rows = std::min(full_size.width, full_size.height);
+  out.big2small_factor = cv::min(1. * lores_max_width / landscape_cols,
+                                 1. * lores_max_height / landscape_rows);
+  // the same size whatever the resolution of img: resize, then rotate the small image only
+  cv::Size lores_size(cvRound(full_size.width * out.big2small_factor),
+                      cvRound(full_size.height * out.big2small_factor));
+  cv::resize(img, out.lores, lores_size);
+  if (rotate) {
+    cv::Mat3b lores_rotated;
+    cv::transpose(out.lores, lores_rotated);
+    cv::flip(lores_rotated, out.lores, 0);
+  }
+} // end prepare_lores()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Compute the preview and the tiled pyramid of a scan, rotated to landscape.
+ * The full resolution is not rotated, only the coordinates are.
+ * \param scan_img_hires
+ *    the scan, as decoded from the file.
+ *    It can be released once the function returned.
+ * \param lores_max_width, lores_max_height
+ *    the bounds of the preview
+ * \param pyramid_min_size
+ *    the smallest side of the last pyramid level, cf build_pyramid()
+ * \param out
+ *    the prepared scan
+ * \param pyramid_dir, pool
+ *    cf build_pyramid()
+ * \return true if success
+ */
+inline bool prepare_scan(const cv::Mat3b & scan_img_hires,
+                         unsigned int lores_max_width,
+                         unsigned int lores_max_height,
+                         unsigned int pyramid_min_size,
+                         PreparedScan & out,
+                         const std::string & pyramid_dir = "",
+                         BufferPool * pool = NULL) {
+  if (scan_img_hires.empty())
+    return false;
+  ScopedStageTimer timer(StageProfiler::PREPARE_SCAN);
+  prepare_lores(scan_img_hires, scan_img_hires.size(),
+                lores_max_width, lores_max_height, out);
+  out.full_resolution = true;
+  bool rotate = (scan_img_hires.cols < scan_img_hires.rows);
+  return build_pyramid(scan_img_hires, rotate, out.pyramid, pyramid_min_size,
+                       pyramid_dir, pool);
+} // end prepare_scan()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Compute the preview and the coarse levels of the pyramid of a scan
+ * from a reduced decode. The finer levels are NULL.
+ * \param reduced
+ *    the scan decoded at 1 / \a reduction of its size
+ * \param full_size
+ *    the size of the scan, as decoded at full resolution
+ * \param reduction
+ *    2, 4 or 8
+ * \return true if success
+ */
+inline bool prepare_scan_preview(const cv::Mat3b & reduced,
+                                 const cv::Size & full_size,
+                                 int reduction,
+                                 unsigned int lores_max_width,
+                                 unsigned int lores_max_height,
+                                 unsigned int pyramid_min_size,
+                                 PreparedScan & out) {
+  if (reduced.empty())
+    return false;
+  ScopedStageTimer timer(StageProfiler::PREPARE_SCAN);
+  prepare_lores(reduced, full_size, lores_max_width, lores_max_height, out);
+  out.full_resolution = false;
+  bool rotate = (full_size.width < full_size.height);
+  TiledPyramid coarse_levels;
+  if (!build_pyramid(reduced, rotate, coarse_levels, pyramid_min_size))
+    return false;
+  out.pyramid.clear();
+  for (int level_size = 1; level_size < reduction; level_size *= 2)
+    out.pyramid.push_back(TiledImagePtr());
+  out.pyramid.insert(out.pyramid.end(), coarse_levels.begin(), coarse_levels.end());
+  return true;
+} // end prepare_scan_preview()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Read the size of a JPEG image from its frame header, without decoding it.
+ * \return false if the file is not a JPEG or could not be read
+ */
+inline bool read_jpeg_size(const std::string & filename, cv::Size & size) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  bool ok = false;
+  if (fgetc(f) == 0xFF && fgetc(f) == 0xD8) { // start of image
+    while (fgetc(f) == 0xFF) {
+      int marker;
+      while ((marker = fgetc(f)) == 0xFF) {} // fill bytes
+      if (marker == EOF || marker == 0xD9 || marker == 0xDA) // end of image, start of scan
+        break;
+      if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) // no length
+        continue;
+      unsigned char header[7];
+      if (fread(header, 1, 2, f) != 2)
+        break;
+      int length = (header[0] << 8) | header[1];
+      // start of frame: all SOFn but DHT (C4), JPG (C8) and DAC (CC)
+      if (marker >= 0xC0 && marker <= 0xCF
+          && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+        if (fread(header + 2, 1, 5, f) == 5) { // precision, height, width
+          size = cv::Size((header[5] << 8) | header[6], (header[3] << 8) | header[4]);
+          ok = (size.width > 0 && size.height > 0);
+        }
+        break;
+      }
+      if (length < 2 || fseek(f, length - 2, SEEK_CUR) != 0)
+        break;
+    } // end while (marker)
+  }
+  fclose(f);
+  return ok;
+} // end read_jpeg_size()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Decode a scan as cv::imread(), in the buffers of a pool.
+ * The JPEGs are read and decoded in place,
+ * the other formats are decoded by cv::imread() in a new buffer.
+ * \return true if success
+ */
+inline bool decode_scan(const std::string & filename, cv::Mat3b & out,
+                        BufferPool & pool) {
+  cv::Size size;
+  FILE* f = (read_jpeg_size(filename, size) ? fopen(filename.c_str(), "rb") : NULL);
+  long file_size = -1;
+  if (f != NULL && fseek(f, 0, SEEK_END) == 0)
+    file_size = ftell(f);
+  if (file_size <= 0) {
+    if (f != NULL)
+      fclose(f);
+    BufferPool::count_allocation();
+    out = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+    return !out.empty();
+  }
+  rewind(f);
+  cv::Mat bytes = pool.acquire(1, file_size, 1);
+  bool ok = (fread(bytes.data, 1, file_size, f) == (size_t) file_size);
+  fclose(f);
+  if (!ok)
+    return false;
+  cv::Mat dst = pool.acquire3b(size.height, size.width);
+  cv::Mat decoded = cv::imdecode(bytes, CV_LOAD_IMAGE_COLOR, &dst);
+  if (decoded.empty())
+    return false;
+  if (decoded.data != dst.data) // resized by the decoder, e.g. for the EXIF orientation
+    BufferPool::count_allocation();
+  out = decoded;
+  return true;
+} // end decode_scan()
+
+////////////////////////////////////////////////////////////////////////////////
+
+class ScanPrefetcher {
+public:
+  /*!
+   * \param lores_max_width, lores_max_height
+   *    the bounds of the previews, cf prepare_scan()
+   * \param pyramid_min_size
+   *    cf prepare_scan()
+   * \param max_cache_bytes
+   *    the cap of the cache, cf PreparedScan::memory_size().
+   *    The most recently used scan is always kept.
+   */
+  ScanPrefetcher(unsigned int lores_max_width, unsigned int lores_max_height,
+                 unsigned int pyramid_min_size, size_t max_cache_bytes) :
+    _lores_max_width(lores_max_width),
+    _lores_max_height(lores_max_height),
+    _pyramid_min_size(pyramid_min_size),
+    _max_cache_bytes(max_cache_bytes),
+    _cache_bytes(0),
+    _stopped(false) {
+    _loader = std::thread(&ScanPrefetcher::loader_loop, this);
+  }
+
+  ~ScanPrefetcher() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! stop the loader thread. Pending prefetches are dropped.
+  inline void stop() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopped = true;
+      _pending.clear();
+      _pending_later.clear();
+    }
+    _work_cond.notify_all();
+    if (_loader.joinable())
+      _loader.join();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Replace the list of scans to decode in the background.
+   * \param filenames
+   *    the scans to prefetch, by decreasing priority.
+   *    Scans already in the cache at full resolution are skipped.
+   */
+  inline void prefetch(const std::vector<std::string> & filenames) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending.clear();
+      for (unsigned int i = 0; i < filenames.size(); ++i) {
+        if (!is_ready(filenames[i]) && _in_progress != filenames[i]
+            && std::find(_pending.begin(), _pending.end(), filenames[i]) == _pending.end())
+          _pending.push_back(filenames[i]);
+      }
+    }
+    _work_cond.notify_all();
+  }
+
+  /*!
+   * Add scans to decode in the background once the prefetch() list is empty.
+   * Unlike prefetch(), the previous requests are kept:
+   * meant for the new scans of a watched folder, each one being decoded once.
+   */
+  inline void prefetch_later(const std::vector<std::string> & filenames) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (unsigned int i = 0; i < filenames.size(); ++i) {
+        if (!is_ready(filenames[i]) && _in_progress != filenames[i]
+            && std::find(_pending_later.begin(), _pending_later.end(), filenames[i])
+            == _pending_later.end())
+          _pending_later.push_back(filenames[i]);
+      }
+    }
+    _work_cond.notify_all();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Get a prepared scan at full resolution.
+   * If it is being decoded in the background, wait for it.
+   * If it was not requested yet, decode it on the calling thread.
+   * \return true if success
+   */
+  inline bool get(const std::string & filename, PreparedScan & out) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      std::map<std::string, CacheEntry>::iterator it = _entries.find(filename);
+      if (it != _entries.end() && it->second.scan.full_resolution) { // cache hit
+        _lru.splice(_lru.begin(), _lru, it->second.lru_it);
+        out = it->second.scan;
+        return true;
+      }
+      if (_in_progress != filename)
+        break;
+      _done_cond.wait(lock);
+    } // end while (true)
+    _pending.erase(std::remove(_pending.begin(), _pending.end(), filename),
+                   _pending.end());
+    _pending_later.erase(std::remove(_pending_later.begin(), _pending_later.end(),
+                                     filename), _pending_later.end());
+    lock.unlock();
+    PreparedScan scan;
+    bool ok = load(filename, scan);
+    lock.lock();
+    if (!ok) {
+      printf("Could not read file '%s'!\n", filename.c_str());
+      return false;
+    }
+    insert(filename, scan);
+    out = scan;
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Keep the prepared scans on disk between sessions, cf ScanDiskCache.
+   * Must be called before any other method.
+   * \param max_bytes
+   *    the size limit of the disk cache, 0 disables it
+   */
+  inline bool enable_disk_cache(const std::string & dir, size_t max_bytes) {
+    return _disk_cache.enable(dir, max_bytes);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! get a prepared scan if it is in the cache at full resolution, never wait
+  inline bool get_if_ready(const std::string & filename, PreparedScan & out) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::string, CacheEntry>::iterator it = _entries.find(filename);
+    if (it == _entries.end() || !it->second.scan.full_resolution)
+      return false;
+    out = it->second.scan;
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Get a scan as fast as possible, for displaying it.
+   * If it is not in the cache, decode a reduced version of it,
+   * cf prepare_scan_preview(), and decode its full resolution in the background.
+   * \param out
+   *    the scan, check out.full_resolution
+   * \return true if success
+   */
+  inline bool get_preview(const std::string & filename, PreparedScan & out) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::map<std::string, CacheEntry>::iterator it = _entries.find(filename);
+      if (it != _entries.end()) {
+        _lru.splice(_lru.begin(), _lru, it->second.lru_it);
+        out = it->second.scan;
+        if (out.full_resolution)
+          return true;
+      }
+    }
+    if (out.pyramid.empty() && _disk_cache.enabled()
+        && load_from_disk_cache(ScanDiskCache::key(filename), out)) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      insert(filename, out);
+      return true;
+    }
+    if (!out.pyramid.empty() || load_preview(filename, out)) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      insert(filename, out);
+      // the full resolution first, before the other prefetches
+      _pending.erase(std::remove(_pending.begin(), _pending.end(), filename),
+                     _pending.end());
+      if (_in_progress != filename && !_stopped)
+        _pending.push_front(filename);
+      _work_cond.notify_all();
+      return true;
+    }
+    return get(filename, out); // not a JPEG
+  } // end get_preview()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  struct CacheEntry {
+    PreparedScan scan;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Prepare a scan at full resolution, from the disk cache if possible.
+   * \return false if it could not be read, decoded or prepared
+   */
+  inline bool load(const std::string & filename, PreparedScan & out) {
+    std::string key = (_disk_cache.enabled() ? ScanDiskCache::key(filename) : "");
+    if (load_from_disk_cache(key, out))
+      return true;
+    cv::Mat3b scan_img;
+    bool decoded;
+    {
+      ScopedStageTimer timer(StageProfiler::DECODE);
+      decoded = decode_scan(filename, scan_img, _buffers);
+    }
+    if (!decoded) // unreadable or corrupt, reported by get()
+      return false;
+    std::string entry_dir = _disk_cache.begin_entry(key);
+    bool ok = prepare_scan(scan_img, _lores_max_width, _lores_max_height,
+                           _pyramid_min_size, out, entry_dir, &_buffers);
+    _disk_cache.commit_entry(key, entry_dir, ok, out.lores, out.big2small_factor,
+                             out.pyramid.size());
+    // the cache may be full or read-only: the scan must open anyway
+    if (!ok && !entry_dir.empty()) {
+      printf("Could not write '%s' in the disk cache, using temporary files\n",
+             filename.c_str());
+      ok = prepare_scan(scan_img, _lores_max_width, _lores_max_height,
+                        _pyramid_min_size, out, "", &_buffers);
+    }
+    return ok;
+  }
+
+  //! \return true if the scan was in the disk cache, at full resolution
+  inline bool load_from_disk_cache(const std::string & key, PreparedScan & out) {
+    if (!_disk_cache.load(key, out.pyramid, out.lores, out.big2small_factor))
+      return false;
+    out.full_resolution = true;
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Decode a JPEG at the smallest reduction larger than the preview,
+   * and prepare the preview and the coarse levels of its pyramid.
+   * \return false if the scan is not a JPEG or if the reduction is useless
+   */
+  inline bool load_preview(const std::string & filename, PreparedScan & out) const {
+#ifdef SCAN_PREFETCHER_REDUCED_DECODE
+    cv::Size full_size;
+    if (!read_jpeg_size(filename, full_size))
+      return false;
+    double big2small_factor = cv::min(
+          1. * _lores_max_width / std::max(full_size.width, full_size.height),
+          1. * _lores_max_height / std::min(full_size.width, full_size.height));
+    int reduction = 8;
+    while (reduction > 1 && reduction * big2small_factor > 1)
+      reduction /= 2;
+    if (reduction == 1)
+      return false;
+    int flags = (reduction == 8 ? cv::IMREAD_REDUCED_COLOR_8
+                 : reduction == 4 ? cv::IMREAD_REDUCED_COLOR_4
+                 : cv::IMREAD_REDUCED_COLOR_2);
+    cv::Mat3b reduced;
+    {
+      ScopedStageTimer timer(StageProfiler::DECODE);
+      reduced = cv::imread(filename, flags);
+    }
+    if (reduced.empty())
+      return false;
+    // the EXIF orientation was applied by the decoder
+    if ((reduced.cols > reduced.rows) != (full_size.width > full_size.height))
+      full_size = cv::Size(full_size.height, full_size.width);
+    return prepare_scan_preview(reduced, full_size, reduction, _lores_max_width,
+                                _lores_max_height, _pyramid_min_size, out);
+#else // SCAN_PREFETCHER_REDUCED_DECODE
+    (void) filename;
+    (void) out;
+    return false;
+#endif // SCAN_PREFETCHER_REDUCED_DECODE
+  } // end load_preview()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return true if a scan is in the cache at full resolution. Locked.
+  inline bool is_ready(const std::string & filename) const {
+    std::map<std::string, CacheEntry>::const_iterator it = _entries.find(filename);
+    return (it != _entries.end() && it->second.scan.full_resolution);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Add a scan to the cache and evict the least recently used ones. Locked.
+   * A scan at full resolution replaces its preview.
+   */
+  inline void insert(const std::string & filename, const PreparedScan & scan) {
+    std::map<std::string, CacheEntry>::iterator it = _entries.find(filename);
+    if (it != _entries.end()) {
+      if (it->second.scan.full_resolution || !scan.full_resolution)
+        return;
+      _cache_bytes -= it->second.scan.memory_size();
+      _lru.erase(it->second.lru_it);
+      _entries.erase(it);
+    }
+    _lru.push_front(filename);
+    CacheEntry & entry = _entries[filename];
+    entry.scan = scan;
+    entry.lru_it = _lru.begin();
+    _cache_bytes += scan.memory_size();
+    while (_cache_bytes > _max_cache_bytes && _lru.size() > 1) {
+      std::map<std::string, CacheEntry>::iterator victim = _entries.find(_lru.back());
+      _cache_bytes -= victim->second.scan.memory_size();
+      _entries.erase(victim);
+      _lru.pop_back();
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  void loader_loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      while (!_stopped && _pending.empty() && _pending_later.empty())
+        _work_cond.wait(lock);
+      if (_stopped)
+        return;
+      std::deque<std::string> & queue = (_pending.empty() ? _pending_later : _pending);
+      std::string filename = queue.front();
+      queue.pop_front();
+      if (is_ready(filename))
+        continue;
+      _in_progress = filename;
+      lock.unlock();
+      PreparedScan scan;
+      bool ok = load(filename, scan);
+      lock.lock();
+      if (ok) // failures are reported by get()
+        insert(filename, scan);
+      _in_progress.clear();
+      _done_cond.notify_all();
+    } // end while (true)
+  } // end loader_loop()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  unsigned int _lores_max_width, _lores_max_height, _pyramid_min_size;
+  size_t _max_cache_bytes, _cache_bytes;
+  std::map<std::string, CacheEntry> _entries;
+  std::list<std::string> _lru; // front: most recently used
+  std::deque<std::string> _pending;
+  std::deque<std::string> _pending_later; // cf prefetch_later()
+  std::string _in_progress;
+  bool _stopped;
+  std::mutex _mutex;
+  std::condition_variable _work_cond, _done_cond;
+  std::thread _loader;
+  ScanDiskCache _disk_cache;
+  BufferPool _buffers; // the decoded scans and their pyramid levels, shared by the threads
+}; // end class ScanPrefetcher
+
+#endif // SCAN_PREFETCHER_H
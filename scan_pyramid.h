@@ -0,0 +1,238 @@
+/*!
+  \file        scan_pyramid.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A mip pyramid of a scan, each level being a TiledImage.
+The zoom window samples the level whose resolution is the closest to the zoom one,
+and only reads and warps the region of interest of this level.
+Its cost thus does not depend on the resolution of the scan.
+The postcards are extracted the same way, reading only the tiles they cover.
+ */
+
+#ifndef SCAN_PYRAMID_H
+#define SCAN_PYRAMID_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "postcard_extraction.h"
+#include "tiled_image.h"
+
+/*!
+ * Level 0 is the full resolution, each level is half the size of the previous.
+ * The first levels can be missing (NULL) while the full resolution is decoded,
+ * cf prepare_scan_preview().
+ */
+typedef std::vector<TiledImagePtr> TiledPyramid;
+
+//! \return the index of the finest level available
+inline int pyramid_first_level(const TiledPyramid & pyramid) {
+  int level = 0;
+  while (level < (int) pyramid.size() - 1 && !pyramid[level])
+    ++level;
+  return level;
+}
+
+//! \example ("/foo", 2) -> "/foo/level2.tiles"
+inline std::string pyramid_level_filename(const std::string & dir, unsigned int level) {
+  std::ostringstream ans;
+  ans << dir << "/level" << level << ".tiles";
+  return ans.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Build a mip pyramid with cv::pyrDown() and cut its levels into tiles.
+ * \param img
+ *    the full resolution image, as decoded
+ * \param rotate_to_landscape
+ *    cf TiledImage::create()
+ * \param pyramid
+ *    the levels
+ * \param min_size
+ *    the halving stops when the smallest side goes below this size
+ * \param dir
+ *    if not empty, the level i is kept in the file pyramid_level_filename(dir, i),
+ *    otherwise in a temporary file
+ * \param pool
+ *    if not NULL, where the levels are computed before being tiled
+ * \return true if success
+ */
+inline bool build_pyramid(const cv::Mat3b & img,
+                          bool rotate_to_landscape,
+                          TiledPyramid & pyramid,
+                          unsigned int min_size,
+                          const std::string & dir = "",
+                          BufferPool * pool = NULL) {
+  pyramid.clear();
+  cv::Mat3b level_img = img, next_level_img;
+  while (!level_img.empty()) {
+    TiledImagePtr level(new TiledImage());
+    std::string path = (dir.empty() ? "" : pyramid_level_filename(dir, pyramid.size()));
+    if (!level->create(level_img, rotate_to_landscape, path))
+      return false;
+    pyramid.push_back(level);
+    if ((unsigned int) std::min(level_img.cols, level_img.rows) / 2 < min_size)
+      break;
+    if (pool)
+      next_level_img = pool->acquire3b((level_img.rows + 1) / 2, (level_img.cols + 1) / 2);
+    cv::pyrDown(level_img, next_level_img);
+    level_img = next_level_img; // the previous level can be released
+    next_level_img = cv::Mat3b();
+  }
+  return !pyramid.empty();
+} // end build_pyramid()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * The level where one output pixel covers between 1 and 2 pixels of the level,
+ * or the finest available level if it is missing.
+ */
+inline int pyramid_level_for_scale(const TiledPyramid & pyramid,
+                                   double scale) {
+  int level = (scale < 2 ? 0 : (int) floor(log2(scale)));
+  level = std::max(level, pyramid_first_level(pyramid));
+  return std::min(level, (int) pyramid.size() - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Resample an axis-aligned square of the level 0 of a pyramid.
+ * The pixels outside the image are black, as with cv::warpAffine().
+ * \param pyramid
+ *    built with build_pyramid()
+ * \param center_x, center_y
+ *    the center of the square, in level 0 coordinates
+ * \param half_size
+ *    the half side of the square, in level 0 coordinates
+ * \param out
+ *    the resampled square, must be allocated
+ */
+inline void warp_square_from_pyramid(const TiledPyramid & pyramid,
+                                     double center_x, double center_y,
+                                     double half_size,
+                                     cv::Mat3b & out) {
+  out.setTo(cv::Scalar::all(0));
+  if (pyramid.empty() || out.empty() || half_size <= 0)
+    return;
+  int level = pyramid_level_for_scale(pyramid, 2 * half_size / out.cols);
+  double level_factor = 1. / (1 << level);
+  double x = center_x * level_factor, y = center_y * level_factor,
+      hs = half_size * level_factor;
+  // the region of interest, with a margin for the bilinear interpolation
+  static const int MARGIN = 2;
+  cv::Rect roi(floor(x - hs) - MARGIN, floor(y - hs) - MARGIN,
+               ceil(2 * hs) + 2 * MARGIN + 1, ceil(2 * hs) + 2 * MARGIN + 1);
+  if ((roi & cv::Rect(cv::Point(0, 0), pyramid[level]->size())).area() == 0)
+    return; // square out of the image
+  cv::Mat3b roi_img;
+  pyramid[level]->get_roi(roi, roi_img);
+  x -= roi.x;
+  y -= roi.y;
+  cv::Point2f src [3]= { cv::Point2f(x - hs, y - hs),
+                         cv::Point2f(x + hs, y - hs),
+                         cv::Point2f(x + hs, y + hs)};
+  cv::Point2f dst [3]= { cv::Point2f(0, 0),
+                         cv::Point2f(out.cols, 0),
+                         cv::Point2f(out.cols, out.rows)};
+  cv::Mat transform = cv::getAffineTransform(src, dst);
+  cv::warpAffine(roi_img, out, transform, out.size());
+} // end warp_square_from_pyramid()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Extract a postcard from a tiled scan, only reading the tiles it covers.
+ * \param corners, postcard
+ *    cf extract_postcard()
+ * \param pool
+ *    if not NULL, where the region of the scan is copied
+ */
+inline bool extract_postcard(const TiledImage & scan,
+                             const cv::Point2f corners[3],
+                             cv::Mat3b & postcard,
+                             BufferPool * pool = NULL) {
+  cv::Point2f all_corners[4] = { corners[0], corners[1], corners[2],
+                                 corners[0] + corners[2] - corners[1] };
+  float xmin = all_corners[0].x, xmax = xmin, ymin = all_corners[0].y, ymax = ymin;
+  for (unsigned int i = 1; i < 4; ++i) {
+    xmin = std::min(xmin, all_corners[i].x);
+    xmax = std::max(xmax, all_corners[i].x);
+    ymin = std::min(ymin, all_corners[i].y);
+    ymax = std::max(ymax, all_corners[i].y);
+  }
+  // the bounding box, with a margin for the bilinear interpolation
+  static const int MARGIN = 2;
+  cv::Rect roi(floor(xmin) - MARGIN, floor(ymin) - MARGIN,
+               ceil(xmax) - floor(xmin) + 2 * MARGIN + 1,
+               ceil(ymax) - floor(ymin) + 2 * MARGIN + 1);
+  cv::Mat3b roi_img;
+  if (pool)
+    roi_img = pool->acquire3b(roi.height, roi.width);
+  scan.get_roi(roi, roi_img, pool);
+  cv::Point2f roi_corners[3];
+  for (unsigned int i = 0; i < 3; ++i)
+    roi_corners[i] = corners[i] - cv::Point2f(roi.x, roi.y);
+  return extract_postcard(roi_img, roi_corners, postcard);
+} // end extract_postcard()
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Extract a small preview of a postcard without warping the full resolution:
+ * the postcard is warped from the pyramid level closest to the preview size.
+ * \param pyramid
+ *    the pyramid of the scan
+ * \param corners
+ *    the corners of the postcard in level 0, cf extract_postcard()
+ * \param max_size
+ *    the bound of the sides of the preview
+ * \param preview
+ *    the straightened preview
+ * \return true if success
+ */
+inline bool extract_postcard_preview(const TiledPyramid & pyramid,
+                                     const cv::Point2f corners[3],
+                                     unsigned int max_size,
+                                     cv::Mat3b & preview) {
+  if (pyramid.empty())
+    return false;
+  double size = std::max(dist_L2(corners[0], corners[1]),
+                         dist_L2(corners[1], corners[2]));
+  int level = pyramid_level_for_scale(pyramid, size / max_size);
+  double level_factor = 1. / (1 << level);
+  cv::Point2f level_corners[3];
+  for (unsigned int i = 0; i < 3; ++i)
+    level_corners[i] = corners[i] * level_factor;
+  cv::Mat3b level_postcard;
+  if (!extract_postcard(*pyramid[level], level_corners, level_postcard))
+    return false;
+  double factor = std::min(1. * max_size / level_postcard.cols,
+                           1. * max_size / level_postcard.rows);
+  cv::resize(level_postcard, preview, cv::Size(), factor, factor, cv::INTER_AREA);
+  return true;
+} // end extract_postcard_preview()
+
+#endif // SCAN_PYRAMID_H
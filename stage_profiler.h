@@ -0,0 +1,218 @@
+/*!
+  \file        tiled_image.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+Low-overhead latency instrumentation of the hot stages of the program.
+The durations are aggregated into logarithmic histograms, one per stage,
+and a summary is printed or written as CSV or JSON at the end of the session.
+When the profiler is disabled, a timer costs a single atomic load.
+ */
+
+#ifndef STAGE_PROFILER_H
+#define STAGE_PROFILER_H
+
+#include <opencv2/core/core.hpp>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+class StageProfiler {
+public:
+  enum Stage {
+    DECODE = 0,      //!< decode_scan(): cv::imdecode() into a pooled buffer, or reduced decode
+    PREPARE_SCAN,    //!< resize, rotation and pyramid of a scan
+    ZOOM_WARP,       //!< resampling of the zoom window
+    CORNER_SNAP,     //!< search of the corner closest to the cursor, in the zoom window
+    REDRAW,          //!< compositing of the main window
+    DETECTION,       //!< automatic detection of the postcards, batch mode
+    EXTRACTION_WARP, //!< full resolution warp of a postcard
+    ENCODE_WRITE,    //!< encoding and writing of a postcard
+    NSTAGES
+  };
+  //! bucket i counts the durations in [2^(i-1), 2^i[ microseconds
+  static const int NBUCKETS = 32;
+
+  //! the profiler shared by the whole program, disabled by default
+  static StageProfiler & instance() {
+    static StageProfiler profiler;
+    return profiler;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Start collecting the durations.
+   * \param output_filename
+   *    where dump() writes the summary: a CSV file if it ends with ".csv",
+   *    a JSON file if it ends with ".json", the standard output if empty
+   */
+  inline void enable(const std::string & output_filename = "") {
+    _output_filename = output_filename;
+    _enabled.store(true, std::memory_order_release);
+  }
+  inline bool enabled() const {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! add a duration, in milliseconds. Thread-safe.
+  inline void add(Stage stage, double ms) {
+    double us = 1000. * ms;
+    int bucket = 0;
+    while (bucket < NBUCKETS - 1 && us >= (1UL << bucket))
+      ++bucket;
+    Histogram & h = _histograms[stage];
+    std::lock_guard<std::mutex> lock(h.mutex);
+    if (h.count == 0 || ms < h.min_ms)
+      h.min_ms = ms;
+    if (h.count == 0 || ms > h.max_ms)
+      h.max_ms = ms;
+    ++h.count;
+    h.total_ms += ms;
+    ++h.buckets[bucket];
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Write the summary of all stages, if enabled.
+   * The percentiles are estimated from the histograms.
+   * \return true if success
+   */
+  bool dump() {
+    if (!enabled())
+      return true;
+    bool csv = ends_with(_output_filename, ".csv"),
+        json = ends_with(_output_filename, ".json");
+    FILE* f = stdout;
+    if (!_output_filename.empty() && (f = fopen(_output_filename.c_str(), "w")) == NULL) {
+      printf("Could not write the profile '%s'!\n", _output_filename.c_str());
+      return false;
+    }
+    if (csv)
+      fprintf(f, "stage,count,total_ms,mean_ms,min_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+    else if (json)
+      fprintf(f, "{\n  \"stages\": [");
+    else
+      fprintf(f, "%-16s %7s %10s %9s %9s %9s %9s %9s %9s\n", "stage", "count",
+              "total ms", "mean", "min", "p50", "p90", "p99", "max");
+    bool first = true;
+    for (int stage = 0; stage < NSTAGES; ++stage) {
+      Histogram & h = _histograms[stage];
+      std::lock_guard<std::mutex> lock(h.mutex);
+      if (h.count == 0)
+        continue;
+      const char* name = stage_name((Stage) stage);
+      double mean = h.total_ms / h.count, p50 = h.percentile(.5),
+          p90 = h.percentile(.9), p99 = h.percentile(.99);
+      if (csv)
+        fprintf(f, "%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", name, h.count,
+                h.total_ms, mean, h.min_ms, p50, p90, p99, h.max_ms);
+      else if (json) {
+        fprintf(f, "%s\n    {\"stage\": \"%s\", \"count\": %lu, \"total_ms\": %.3f, "
+                "\"mean_ms\": %.3f, \"min_ms\": %.3f, \"p50_ms\": %.3f, "
+                "\"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f,\n"
+                "     \"histogram_us\": [", (first ? "" : ","), name, h.count,
+                h.total_ms, mean, h.min_ms, p50, p90, p99, h.max_ms);
+        for (int b = 0; b < NBUCKETS; ++b)
+          fprintf(f, "%s%lu", (b ? ", " : ""), h.buckets[b]);
+        fprintf(f, "]}");
+      }
+      else
+        fprintf(f, "%-16s %7lu %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+                h.count, h.total_ms, mean, h.min_ms, p50, p90, p99, h.max_ms);
+      first = false;
+    } // end for stage
+    if (json)
+      fprintf(f, "\n  ]\n}\n");
+    if (f != stdout) {
+      fclose(f);
+      printf("Profile written in '%s'\n", _output_filename.c_str());
+    }
+    return true;
+  } // end dump()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  static const char* stage_name(Stage stage) {
+    static const char* names[NSTAGES] = {
+      "decode", "prepare_scan", "zoom_warp", "corner_snap", "redraw", "detection",
+      "extraction_warp", "encode_write" };
+    return names[stage];
+  }
+
+protected:
+  struct Histogram {
+    Histogram() : count(0), total_ms(0), min_ms(0), max_ms(0) {
+      std::fill(buckets, buckets + NBUCKETS, 0);
+    }
+    //! the percentile \a p in ms, interpolated within its bucket
+    inline double percentile(double p) const {
+      unsigned long rank = p * count, seen = 0;
+      for (int b = 0; b < NBUCKETS; ++b) {
+        if (seen + buckets[b] > rank) {
+          double lower_us = (b == 0 ? 0 : (1UL << (b - 1))), upper_us = (1UL << b);
+          double ratio = (rank - seen + .5) / buckets[b];
+          double ans = (lower_us + ratio * (upper_us - lower_us)) / 1000.;
+          return std::max(min_ms, std::min(max_ms, ans));
+        }
+        seen += buckets[b];
+      }
+      return max_ms;
+    }
+    std::mutex mutex;
+    unsigned long count;
+    double total_ms, min_ms, max_ms;
+    unsigned long buckets[NBUCKETS];
+  }; // end struct Histogram
+
+  StageProfiler() : _enabled(false) {}
+
+  static inline bool ends_with(const std::string & s, const std::string & suffix) {
+    return s.size() >= suffix.size()
+        && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  std::atomic<bool> _enabled;
+  std::string _output_filename;
+  Histogram _histograms[NSTAGES];
+}; // end class StageProfiler
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! time its scope and add the duration to a stage of the profiler, if enabled
+class ScopedStageTimer {
+public:
+  ScopedStageTimer(StageProfiler::Stage stage) : _stage(stage),
+    _start(StageProfiler::instance().enabled() ? cv::getTickCount() : 0) {}
+  ~ScopedStageTimer() {
+    if (_start != 0)
+      StageProfiler::instance().add(_stage, (cv::getTickCount() - _start)
+                                    * 1000. / cv::getTickFrequency());
+  }
+protected:
+  StageProfiler::Stage _stage;
+  int64 _start;
+}; // end class ScopedStageTimer
+
+#endif // STAGE_PROFILER_H
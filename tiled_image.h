@@ -0,0 +1,326 @@
+/*!
+  \file        tiled_image.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A color image cut into square tiles stored in a memory-mapped file.
+Only the tiles touched recently stay mapped in memory,
+so that the memory used by a scan is bounded whatever its size.
+The file is temporary, or kept for being opened again, cf ScanDiskCache.
+
+The image can be rotated of 90° to landscape: the rotation is only applied
+to the coordinates and to the small regions read with get_roi().
+ */
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer_pool.h"
+
+class TiledImage {
+public:
+  static const int TILE_SIZE = 256; // a tile is 48 pages of 4 kB
+  //! the number of tiles kept in memory, 12 MB
+  static const unsigned int MAX_RESIDENT_TILES = 64;
+  //! the header of the file, one page so that the tiles stay page-aligned
+  static const size_t HEADER_BYTES = 4096;
+
+  TiledImage() : _fd(-1), _data(NULL), _file_size(0), _rotated(false),
+    _stored_cols(0), _stored_rows(0), _ntiles_x(0), _ntiles_y(0) {}
+
+  ~TiledImage() { release(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Cut an image into tiles.
+   * \param img
+   *    the image, it can be released once the function returned
+   * \param rotate_to_landscape
+   *    if true, the logical image is \\a img rotated of 90°,
+   *    as cv::transpose() followed by cv::flip(, 0)
+   * \param path
+   *    the file where the tiles are kept, for open().
+   *    If empty, an anonymous temporary file, deleted when released.
+   * \return true if success
+   */
+  bool create(const cv::Mat3b & img, bool rotate_to_landscape,
+              const std::string & path = "") {
+    release();
+    if (img.empty())
+      return false;
+    _rotated = rotate_to_landscape;
+    _stored_cols = img.cols;
+    _stored_rows = img.rows;
+    _ntiles_x = (img.cols + TILE_SIZE - 1) / TILE_SIZE;
+    _ntiles_y = (img.rows + TILE_SIZE - 1) / TILE_SIZE;
+    _file_size = HEADER_BYTES + tile_bytes() * _ntiles_x * _ntiles_y;
+    if (!path.empty()) {
+      _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (_fd < 0) {
+        printf("TiledImage: could not create '%s'!\n", path.c_str());
+        return false;
+      }
+    }
+    else { // an anonymous temporary file, deleted when closed
+      const char* tmpdir = getenv("TMPDIR");
+      std::string tmp_path = std::string(tmpdir ? tmpdir : "/tmp") + "/postcard_tiles_XXXXXX";
+      std::vector<char> path_buffer(tmp_path.begin(), tmp_path.end());
+      path_buffer.push_back('\0');
+      _fd = mkstemp(&(path_buffer[0]));
+      if (_fd < 0) {
+        printf("TiledImage: could not create '%s'!\n", tmp_path.c_str());
+        return false;
+      }
+      unlink(&(path_buffer[0]));
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HEADER_MAGIC, sizeof(header.magic));
+    header.stored_cols = _stored_cols;
+    header.stored_rows = _stored_rows;
+    header.rotated = _rotated;
+    header.tile_size = TILE_SIZE;
+    if (ftruncate(_fd, _file_size) != 0
+        || pwrite(_fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+      printf("TiledImage: could not allocate %li bytes!\n", (long) _file_size);
+      release();
+      return false;
+    }
+    // write the tiles without mapping them
+    cv::Mat3b tile(TILE_SIZE, TILE_SIZE);
+    for (int ty = 0; ty < _ntiles_y; ++ty) {
+      for (int tx = 0; tx < _ntiles_x; ++tx) {
+        cv::Rect roi = tile_rect(tx, ty);
+        tile.setTo(cv::Scalar::all(0));
+        cv::Mat3b tile_roi = tile(cv::Rect(0, 0, roi.width, roi.height));
+        img(roi).copyTo(tile_roi);
+        if (pwrite(_fd, tile.data, tile_bytes(), tile_offset(tx, ty))
+            != (ssize_t) tile_bytes()) {
+          printf("TiledImage: could not write tile (%i, %i)!\n", tx, ty);
+          release();
+          return false;
+        }
+      } // end for tx
+    } // end for ty
+    return map();
+  } // end create()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Map the tiles written by create() in a file.
+   * \return true if success
+   */
+  bool open(const std::string & path) {
+    release();
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0)
+      return false;
+    Header header;
+    struct stat file_stat;
+    if (pread(_fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)
+        || memcmp(header.magic, HEADER_MAGIC, sizeof(header.magic)) != 0
+        || header.tile_size != TILE_SIZE || fstat(_fd, &file_stat) != 0) {
+      printf("TiledImage: '%s' is not a tile file!\n", path.c_str());
+      release();
+      return false;
+    }
+    _rotated = header.rotated;
+    _stored_cols = header.stored_cols;
+    _stored_rows = header.stored_rows;
+    _ntiles_x = (_stored_cols + TILE_SIZE - 1) / TILE_SIZE;
+    _ntiles_y = (_stored_rows + TILE_SIZE - 1) / TILE_SIZE;
+    _file_size = HEADER_BYTES + tile_bytes() * _ntiles_x * _ntiles_y;
+    if ((size_t) file_stat.st_size != _file_size) {
+      printf("TiledImage: '%s' is truncated!\n", path.c_str());
+      release();
+      return false;
+    }
+    return map();
+  } // end open()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  void release() {
+    if (_data != NULL)
+      munmap(_data, _file_size);
+    if (_fd >= 0)
+      close(_fd);
+    _data = NULL;
+    _fd = -1;
+    _file_size = 0;
+    _stored_cols = _stored_rows = _ntiles_x = _ntiles_y = 0;
+    _resident.clear();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline bool empty() const { return _data == NULL; }
+  //! the logical width, after the rotation to landscape
+  inline int cols() const { return (_rotated ? _stored_rows : _stored_cols); }
+  //! the logical height, after the rotation to landscape
+  inline int rows() const { return (_rotated ? _stored_cols : _stored_rows); }
+  inline cv::Size size() const { return cv::Size(cols(), rows()); }
+  //! the size of the backing file
+  inline size_t file_size() const { return _file_size; }
+  //! the position in the stored image, i.e. in the decoded file, of a logical point
+  inline cv::Point2f stored_point(const cv::Point2f & p) const {
+    return (_rotated ? cv::Point2f(_stored_cols - 1 - p.y, p.x) : p);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Read a region of the logical image.
+   * Only the tiles intersecting the region are read.
+   * \param roi
+   *    the region, in logical coordinates. The parts outside are black.
+   * \param out
+   *    the pixels of the region, of size roi.size().
+   *    It is written in place if given with this size.
+   * \param pool
+   *    if not NULL, where the temporary buffers are taken
+   */
+  void get_roi(const cv::Rect & roi, cv::Mat3b & out, BufferPool * pool = NULL) const {
+    out.create(roi.height, roi.width);
+    cv::Rect inside = roi & cv::Rect(0, 0, cols(), rows());
+    if (inside != roi || empty())
+      out.setTo(cv::Scalar::all(0));
+    if (empty() || inside.width <= 0 || inside.height <= 0)
+      return;
+    cv::Mat3b out_inside = out(inside - roi.tl());
+    if (!_rotated) {
+      copy_stored_roi(inside, out_inside);
+      return;
+    }
+    // logical (x, y) is stored (_stored_cols - 1 - y, x)
+    cv::Rect stored_roi(_stored_cols - inside.y - inside.height, inside.x,
+                        inside.height, inside.width);
+    cv::Mat3b stored;
+    if (pool)
+      stored = pool->acquire3b(stored_roi.height, stored_roi.width);
+    copy_stored_roi(stored_roi, stored);
+    cv::transpose(stored, out_inside);
+    cv::flip(out_inside, out_inside, 0);
+  } // end get_roi()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  inline size_t tile_bytes() const { return 3 * TILE_SIZE * TILE_SIZE; }
+  inline size_t tile_offset(int tx, int ty) const {
+    return HEADER_BYTES + tile_bytes() * (ty * _ntiles_x + tx);
+  }
+  //! the pixels of a tile in the stored image
+  inline cv::Rect tile_rect(int tx, int ty) const {
+    cv::Rect ans(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+    return ans & cv::Rect(0, 0, _stored_cols, _stored_rows);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! copy a region of the stored image, that must be inside it
+  void copy_stored_roi(const cv::Rect & roi, cv::Mat3b & out) const {
+    out.create(roi.height, roi.width);
+    int tx_min = roi.x / TILE_SIZE, tx_max = (roi.x + roi.width - 1) / TILE_SIZE;
+    int ty_min = roi.y / TILE_SIZE, ty_max = (roi.y + roi.height - 1) / TILE_SIZE;
+    for (int ty = ty_min; ty <= ty_max; ++ty) {
+      for (int tx = tx_min; tx <= tx_max; ++tx) {
+        cv::Rect tile_roi = tile_rect(tx, ty) & roi;
+        cv::Mat3b tile(TILE_SIZE, TILE_SIZE,
+                       (cv::Vec3b*) (_data + tile_offset(tx, ty)));
+        cv::Mat3b out_roi = out(tile_roi - roi.tl());
+        tile(tile_roi - tile_rect(tx, ty).tl()).copyTo(out_roi);
+        touch_tile(ty * _ntiles_x + tx);
+      } // end for tx
+    } // end for ty
+  } // end copy_stored_roi()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  bool map() {
+    _data = (uchar*) mmap(NULL, _file_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (_data == MAP_FAILED) {
+      _data = NULL;
+      printf("TiledImage: could not map %li bytes!\n", (long) _file_size);
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! mark a tile as recently used and unmap the least recently used ones
+  void touch_tile(int tile_idx) const {
+    std::lock_guard<std::mutex> lock(_resident_mutex);
+    std::list<int>::iterator it = std::find(_resident.begin(), _resident.end(), tile_idx);
+    if (it != _resident.end()) {
+      _resident.splice(_resident.begin(), _resident, it);
+      return;
+    }
+    _resident.push_front(tile_idx);
+    while (_resident.size() > MAX_RESIDENT_TILES) {
+      // the pages stay in the file, they will be read again if needed
+      madvise(_data + HEADER_BYTES + tile_bytes() * _resident.back(), tile_bytes(),
+              MADV_DONTNEED);
+      _resident.pop_back();
+    }
+  } // end touch_tile()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  struct Header {
+    char magic[8];
+    int32_t stored_cols, stored_rows, rotated, tile_size;
+  };
+  static constexpr const char* HEADER_MAGIC = "PSETILE1";
+
+  int _fd;
+  uchar* _data;
+  size_t _file_size;
+  bool _rotated;
+  int _stored_cols, _stored_rows, _ntiles_x, _ntiles_y;
+  mutable std::list<int> _resident; // front: most recently used
+  mutable std::mutex _resident_mutex;
+
+private:
+  TiledImage(const TiledImage &);
+  TiledImage & operator=(const TiledImage &);
+}; // end class TiledImage
+
+typedef std::shared_ptr<TiledImage> TiledImagePtr;
+
+#endif // TILED_IMAGE_H
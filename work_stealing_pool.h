@@ -0,0 +1,182 @@
+/*!
+  \file        work_stealing_pool.h
+  \author      agent <agent@local>
+  \date        2026/10/16
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+A thread pool where each worker has its own task deque.
+A worker pops its own tasks from the back and, when it runs out of work,
+steals from the front of the other deques.
+This keeps all cores busy even when the tasks have very different costs,
+as scans of different sizes do.
+ */
+
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+  typedef std::function<void()> Task;
+
+  /*!
+   * \param nthreads
+   *    the number of workers. 0 means one per core.
+   */
+  WorkStealingPool(unsigned int nthreads = 0) :
+    _next_queue(0), _nqueued(0), _nrunning(0), _stopped(false) {
+    if (nthreads == 0)
+      nthreads = std::max(1u, std::thread::hardware_concurrency());
+    _queues.resize(nthreads);
+    for (unsigned int i = 0; i < nthreads; ++i)
+      _queues[i] = new WorkerQueue();
+    for (unsigned int i = 0; i < nthreads; ++i)
+      _workers.push_back(std::thread(&WorkStealingPool::worker_loop, this, i));
+  }
+
+  ~WorkStealingPool() {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopped = true;
+    }
+    _work_cond.notify_all();
+    for (unsigned int i = 0; i < _workers.size(); ++i)
+      _workers[i].join();
+    for (unsigned int i = 0; i < _queues.size(); ++i)
+      delete _queues[i];
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline unsigned int nthreads() const { return _workers.size(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! queue a task, the queues are filled in a round-robin fashion
+  inline void submit(const Task & task) {
+    WorkerQueue* q;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      q = _queues[_next_queue];
+      _next_queue = (_next_queue + 1) % _queues.size();
+    }
+    {
+      std::lock_guard<std::mutex> qlock(q->mutex);
+      q->tasks.push_back(task);
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_nqueued;
+    }
+    _work_cond.notify_one();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! block until all submitted tasks are over
+  inline void wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_nqueued > 0 || _nrunning > 0)
+      _done_cond.wait(lock);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+protected:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! pop from the back of our own queue, else steal from the front of another
+  inline bool pop_task(unsigned int worker_idx, Task & task) {
+    unsigned int nqueues = _queues.size();
+    for (unsigned int i = 0; i < nqueues; ++i) {
+      WorkerQueue* q = _queues[(worker_idx + i) % nqueues];
+      std::lock_guard<std::mutex> qlock(q->mutex);
+      if (q->tasks.empty())
+        continue;
+      if (i == 0) {
+        task = q->tasks.back();
+        q->tasks.pop_back();
+      }
+      else {
+        task = q->tasks.front();
+        q->tasks.pop_front();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  void worker_loop(unsigned int worker_idx) {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stopped && _nqueued == 0)
+          _work_cond.wait(lock);
+        if (_nqueued == 0) // stopped
+          return;
+        --_nqueued;
+        ++_nrunning;
+      }
+      // a task is reserved for us: it is in one of the queues
+      Task task;
+      while (!pop_task(worker_idx, task))
+        std::this_thread::yield();
+      // an exception would terminate the program: the other tasks go on
+      try {
+        task();
+      } catch (const std::exception & e) {
+        printf("A task of the pool failed: %s\n", e.what());
+      } catch (...) {
+        printf("A task of the pool failed!\n");
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_nrunning;
+      }
+      _done_cond.notify_all();
+    } // end while (true)
+  } // end worker_loop()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::vector<WorkerQueue*> _queues;
+  std::vector<std::thread> _workers;
+  unsigned int _next_queue, _nqueued, _nrunning;
+  bool _stopped;
+  std::mutex _mutex;
+  std::condition_variable _work_cond, _done_cond;
+}; // end class WorkStealingPool
+
+#endif // WORK_STEALING_POOL_H